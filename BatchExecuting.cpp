@@ -0,0 +1,278 @@
+/*
+  This file is part of the DSP-Crowd project
+  https://www.dsp-crowd.com
+
+  Author(s):
+      - Johannes Natter, office@dsp-crowd.com
+
+  File created on 19.10.2026
+
+  Copyright (C) 2026, Johannes Natter
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <unistd.h>
+
+#include "BatchExecuting.h"
+
+#define dForEach_ProcState(gen) \
+		gen(StStart) \
+		gen(StMain) \
+
+#define dGenProcStateEnum(s) s,
+dProcessStateEnum(ProcState);
+
+#if 1
+#define dGenProcStateString(s) #s,
+dProcessStateStr(ProcState);
+#endif
+
+using namespace std;
+
+BatchExecuting::BatchExecuting()
+	: Processing("BatchExecuting")
+	//, mStartMs(0)
+	, mJobs()
+	, mResults()
+	, mLstRunning()
+	, mIdxJobNext(0)
+	, mNumJobsDone(0)
+	, mNumJobsFailed(0)
+	, mNumParallelMax(0)
+	, mMsTimeoutJob(0)
+{
+	mState = StStart;
+}
+
+/* member functions */
+
+/*
+ * Jobs must be added before the process is started
+ */
+BatchExecuting &BatchExecuting::jobAdd(const vector<string> &args, const string &strIn)
+{
+	if (mState != StStart)
+		return *this;
+
+	if (!args.size())
+	{
+		procWrnLog("could not add job. No arguments");
+		return *this;
+	}
+
+	mJobs.emplace_back();
+	mJobs.back().args = args;
+	mJobs.back().strIn = strIn;
+
+	return *this;
+}
+
+/*
+ * 0: Number of online processor cores
+ */
+BatchExecuting &BatchExecuting::numParallelMaxSet(size_t numMax)
+{
+	mNumParallelMax = numMax;
+	return *this;
+}
+
+/*
+ * Wall clock timeout for each job.
+ * 0: No timeout
+ */
+BatchExecuting &BatchExecuting::msTimeoutJobSet(uint32_t msTimeout)
+{
+	mMsTimeoutJob = msTimeout;
+	return *this;
+}
+
+Success BatchExecuting::process()
+{
+	//uint32_t curTimeMs = millis();
+	//uint32_t diffMs = curTimeMs - mStartMs;
+	Success success;
+	long numCores;
+#if 0
+	dStateTrace;
+#endif
+	switch (mState)
+	{
+	case StStart:
+
+		if (!mNumParallelMax)
+		{
+			numCores = sysconf(_SC_NPROCESSORS_ONLN);
+			mNumParallelMax = numCores > 0 ? numCores : 1;
+		}
+
+		mResults.resize(mJobs.size());
+
+		procDbgLog("executing %zu jobs. Parallel: %zu",
+				mJobs.size(), mNumParallelMax);
+
+		mState = StMain;
+
+		break;
+	case StMain:
+
+		jobsCheck();
+
+		success = jobsStart();
+		if (success != Pending)
+			return success;
+
+		if (mNumJobsDone < mJobs.size())
+			break;
+
+		procDbgLog("all jobs done. Failed: %zu", mNumJobsFailed);
+
+		return Positive;
+
+		break;
+	default:
+		break;
+	}
+
+	return Pending;
+}
+
+Success BatchExecuting::shutdown()
+{
+	list<BeJobRunning>::iterator iter;
+
+	iter = mLstRunning.begin();
+	for (; iter != mLstRunning.end(); ++iter)
+		cancel(iter->pExec);
+
+	mLstRunning.clear();
+
+	return Positive;
+}
+
+/*
+ * The number of running jobs is kept at the limit
+ * as long as jobs are left
+ */
+Success BatchExecuting::jobsStart()
+{
+	FileExecuting *pExec;
+	BeJobRunning job;
+	VecConstChar argv;
+	BeJob *pJob;
+	size_t i;
+
+	while (mLstRunning.size() < mNumParallelMax && mIdxJobNext < mJobs.size())
+	{
+		pJob = &mJobs[mIdxJobNext];
+
+		pExec = FileExecuting::create();
+		if (!pExec)
+			return procErrLog(-1, "could not create process");
+
+		argv.clear();
+		for (i = 0; i < pJob->args.size(); ++i)
+			argv.push_back(pJob->args[i].c_str());
+
+		pExec->cmdAdd(argv);
+
+		if (pJob->strIn.size())
+			pExec->sourceSet(&pJob->strIn);
+
+		pExec->sinkCapture(0, STDOUT_FILENO);
+		pExec->sinkCapture(0, STDERR_FILENO);
+
+		if (mMsTimeoutJob)
+			pExec->msTimeoutSet(mMsTimeoutJob);
+
+		start(pExec);
+
+		job.pExec = pExec;
+		job.idx = mIdxJobNext;
+		job.msStart = millis();
+
+		mLstRunning.push_back(job);
+		++mIdxJobNext;
+	}
+
+	return Pending;
+}
+
+void BatchExecuting::jobsCheck()
+{
+	list<BeJobRunning>::iterator iter;
+	Success success;
+
+	iter = mLstRunning.begin();
+	while (iter != mLstRunning.end())
+	{
+		success = iter->pExec->success();
+		if (success == Pending)
+		{
+			++iter;
+			continue;
+		}
+
+		jobFinish(*iter, success);
+
+		repel(iter->pExec);
+		iter = mLstRunning.erase(iter);
+	}
+}
+
+/*
+ * CPU times are taken from the resource usage
+ * reported by the kernel when the child terminated
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man2/wait4.2.html
+ * - https://man7.org/linux/man-pages/man2/getrusage.2.html
+ */
+void BatchExecuting::jobFinish(const BeJobRunning &job, Success success)
+{
+	BeJobResult *pRes = &mResults[job.idx];
+	FileExecuting *pExec = job.pExec;
+
+	pRes->res = pExec->result();
+	pRes->success = success;
+	pRes->strOut = pExec->captureStrTake(STDOUT_FILENO);
+	pRes->strErr = pExec->captureStrTake(STDERR_FILENO);
+	pRes->msWall = millis() - job.msStart;
+	pRes->msCpuUser = pExec->msCpuUser();
+	pRes->msCpuSys = pExec->msCpuSys();
+	pRes->finished = true;
+
+	if (success != Positive || pRes->res.childTerminatedBySig || pRes->res.codeRet)
+		++mNumJobsFailed;
+
+	++mNumJobsDone;
+
+	procDbgLog("job %zu done. Code %d. Wall %ums, CPU %ums",
+			job.idx, pRes->res.codeRet, pRes->msWall,
+			pRes->msCpuUser + pRes->msCpuSys);
+}
+
+void BatchExecuting::processInfo(char *pBuf, char *pBufEnd)
+{
+#if 1
+	dInfo("State\t\t\t%s\n", ProcStateString[mState]);
+#endif
+	dInfo("Jobs done\t\t%zu / %zu\n", mNumJobsDone, mJobs.size());
+	dInfo("Jobs running\t\t%zu / %zu\n", mLstRunning.size(), mNumParallelMax);
+	dInfo("Jobs failed\t\t%zu\n", mNumJobsFailed);
+}
+
+/* static functions */
+
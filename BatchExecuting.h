@@ -0,0 +1,130 @@
+/*
+  This file is part of the DSP-Crowd project
+  https://www.dsp-crowd.com
+
+  Author(s):
+      - Johannes Natter, office@dsp-crowd.com
+
+  File created on 19.10.2026
+
+  Copyright (C) 2026, Johannes Natter
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BATCH_EXECUTING_H
+#define BATCH_EXECUTING_H
+
+#include <string>
+#include <vector>
+#include <list>
+
+#include "Processing.h"
+#include "FileExecuting.h"
+
+struct BeJob
+{
+	std::vector<std::string> args;
+	std::string strIn; // Sent to stdin if not empty
+};
+
+struct BeJobResult
+{
+	FeResult res;
+	Success success; // Of the FileExecuting() process
+	std::string strOut;
+	std::string strErr;
+	uint32_t msWall;
+	uint32_t msCpuUser;
+	uint32_t msCpuSys;
+	bool finished;
+};
+
+struct BeJobRunning
+{
+	FileExecuting *pExec;
+	size_t idx;
+	uint32_t msStart;
+};
+
+class BatchExecuting : public Processing
+{
+
+public:
+
+	static BatchExecuting *create()
+	{
+		return new dNoThrow BatchExecuting;
+	}
+
+	BatchExecuting &jobAdd(const std::vector<std::string> &args,
+				const std::string &strIn = "");
+	BatchExecuting &numParallelMaxSet(size_t numMax);
+	BatchExecuting &msTimeoutJobSet(uint32_t msTimeout);
+
+	size_t numJobs() const
+	{ return mJobs.size(); }
+	size_t numJobsDone() const
+	{ return mNumJobsDone; }
+	size_t numJobsFailed() const
+	{ return mNumJobsFailed; }
+
+	const std::vector<BeJobResult> &results() const
+	{ return mResults; }
+
+protected:
+
+	virtual ~BatchExecuting() {}
+
+private:
+
+	BatchExecuting();
+	BatchExecuting(const BatchExecuting &) = delete;
+	BatchExecuting &operator=(const BatchExecuting &) = delete;
+
+	/*
+	 * Naming of functions:  objectVerb()
+	 * Example:              peerAdd()
+	 */
+
+	/* member functions */
+	Success process();
+	Success shutdown();
+	void processInfo(char *pBuf, char *pBufEnd);
+
+	Success jobsStart();
+	void jobsCheck();
+	void jobFinish(const BeJobRunning &job, Success success);
+
+	/* member variables */
+	//uint32_t mStartMs;
+	std::vector<BeJob> mJobs;
+	std::vector<BeJobResult> mResults;
+	std::list<BeJobRunning> mLstRunning;
+	size_t mIdxJobNext;
+	size_t mNumJobsDone;
+	size_t mNumJobsFailed;
+	size_t mNumParallelMax;
+	uint32_t mMsTimeoutJob;
+
+	/* static functions */
+
+	/* static variables */
+
+	/* constants */
+
+};
+
+#endif
+
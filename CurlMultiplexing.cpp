@@ -0,0 +1,458 @@
+/*
+  This file is part of the DSP-Crowd project
+  https://www.dsp-crowd.com
+
+  Author(s):
+      - Johannes Natter, office@dsp-crowd.com
+
+  File created on 19.10.2026
+
+  Copyright (C) 2026, Johannes Natter
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+#include "CurlMultiplexing.h"
+
+#define dForEach_ProcState(gen) \
+		gen(StStart) \
+		gen(StMain) \
+
+#define dGenProcStateEnum(s) s,
+dProcessStateEnum(ProcState);
+
+#define dForEach_SdState(gen) \
+		gen(StSdStart) \
+
+#define dGenSdStateEnum(s) s,
+dProcessStateEnum(SdState);
+
+#if 1
+#define dGenProcStateString(s) #s,
+dProcessStateStr(ProcState);
+#endif
+
+using namespace std;
+
+const long cNumConnsCachedMax = 32;
+#if defined(__linux__)
+const int cNumEventsMax = 32;
+#endif
+
+mutex CurlMultiplexing::mtxMulti;
+CURLM *CurlMultiplexing::pMulti = NULL;
+bool CurlMultiplexing::enginePresent = false;
+unordered_map<CURL *, CurlBinding> CurlMultiplexing::bindings;
+#if defined(__linux__)
+int CurlMultiplexing::fdEpoll = -1;
+bool CurlMultiplexing::timerActive = false;
+uint32_t CurlMultiplexing::msTimerStart = 0;
+uint32_t CurlMultiplexing::msTimerDuration = 0;
+#endif
+
+CurlMultiplexing::CurlMultiplexing()
+	: Processing("CurlMultiplexing")
+	, mStateSd(StSdStart)
+	, mIsEngine(false)
+{
+	mState = StStart;
+}
+
+/* member functions */
+
+Success CurlMultiplexing::process()
+{
+	//uint32_t curTimeMs = millis();
+	//uint32_t diffMs = curTimeMs - mStartMs;
+	//Success success;
+#if 0
+	dStateTrace;
+#endif
+	switch (mState)
+	{
+	case StStart:
+
+		{
+#if CONFIG_PROC_HAVE_DRIVERS
+			Guard lock(mtxMulti);
+#endif
+			if (enginePresent)
+			{
+				procDbgLog("curl multiplexer running already");
+				return -1;
+			}
+
+			enginePresent = true;
+			mIsEngine = true;
+		}
+
+		mState = StMain;
+
+		break;
+	case StMain:
+
+		{
+#if CONFIG_PROC_HAVE_DRIVERS
+			Guard lock(mtxMulti);
+#endif
+			multiProcess();
+		}
+
+		break;
+	default:
+		break;
+	}
+
+	return Pending;
+}
+
+/*
+ * Transfers stay bound. From now on
+ * they are driven by the clients again
+ */
+Success CurlMultiplexing::shutdown()
+{
+	switch (mStateSd)
+	{
+	case StSdStart:
+
+		if (mIsEngine)
+		{
+#if CONFIG_PROC_HAVE_DRIVERS
+			Guard lock(mtxMulti);
+#endif
+			enginePresent = false;
+			mIsEngine = false;
+		}
+
+		return Positive;
+
+		break;
+	default:
+		break;
+	}
+
+	return Pending;
+}
+
+void CurlMultiplexing::processInfo(char *pBuf, char *pBufEnd)
+{
+#if 1
+	dInfo("State\t\t\t%s\n", ProcStateString[mState]);
+#endif
+	dInfo("Transfers\t\t%zu\n", numTransfers());
+}
+
+/* static functions */
+
+/*
+ * The callback is called when the transfer is done.
+ * At this point the easy handle is already removed from
+ * the multi handle. The callback must not add or remove
+ * easy handles.
+ * All callbacks run with the mutex locked on the thread
+ * driving the transfers. This may not be the thread of the
+ * client. The done callback should only store the result
+ * and publish it using a release store. Other state written
+ * by callbacks is read by the client after easyRemove()
+ */
+Success CurlMultiplexing::easyAdd(CURL *pCurl, FuncCurlDone pFctDone, void *pUser)
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mtxMulti);
+#endif
+	CurlBinding binding;
+	CURLMcode code;
+
+	if (!pCurl)
+		return errLog(-1, "curl easy handle not set");
+
+	if (!pMulti)
+		pMulti = multiInit();
+
+	if (!pMulti)
+		return errLog(-1, "curl multi handle not set");
+
+	code = curl_multi_add_handle(pMulti, pCurl);
+	if (code != CURLM_OK)
+		return errLog(-1, "could not add curl easy handle: %s", curl_multi_strerror(code));
+
+	binding.pFctDone = pFctDone;
+	binding.pUser = pUser;
+
+	bindings[pCurl] = binding;
+
+	return Positive;
+}
+
+/*
+ * No callback of the handle runs after returning
+ *
+ * Literature
+ * - https://curl.se/libcurl/c/curl_multi_remove_handle.html
+ */
+void CurlMultiplexing::easyRemove(CURL *pCurl)
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mtxMulti);
+#endif
+	unordered_map<CURL *, CurlBinding>::iterator iter;
+	CURLMcode code;
+
+	iter = bindings.find(pCurl);
+	if (iter == bindings.end())
+		return;
+
+	bindings.erase(iter);
+
+	code = curl_multi_remove_handle(pMulti, pCurl);
+	if (code != CURLM_OK)
+		wrnLog("could not remove curl easy handle: %s", curl_multi_strerror(code));
+}
+
+/*
+ * Called by the clients in each cycle. Does nothing
+ * if a CurlMultiplexing() process drives the transfers
+ */
+void CurlMultiplexing::transfersProcess()
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mtxMulti);
+#endif
+	if (enginePresent)
+		return;
+
+	multiProcess();
+}
+
+size_t CurlMultiplexing::numTransfers()
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mtxMulti);
+#endif
+	return bindings.size();
+}
+
+/*
+ * Literature
+ * - https://curl.se/libcurl/c/curl_multi_init.html
+ * - https://curl.se/libcurl/c/CURLMOPT_MAXCONNECTS.html
+ * - https://curl.se/libcurl/c/CURLMOPT_SOCKETFUNCTION.html
+ * - https://curl.se/libcurl/c/CURLMOPT_TIMERFUNCTION.html
+ * - https://man7.org/linux/man-pages/man2/epoll_create.2.html
+ */
+CURLM *CurlMultiplexing::multiInit()
+{
+	CURLM *pCurlMulti;
+
+	curlGlobalInit();
+
+	Processing::globalDestructorRegister(multiDeInit);
+
+	pCurlMulti = curl_multi_init();
+	if (!pCurlMulti)
+		return NULL;
+
+	// One connection cache for all protocols
+	curl_multi_setopt(pCurlMulti, CURLMOPT_MAXCONNECTS, cNumConnsCachedMax);
+#if defined(__linux__)
+	fdEpoll = epoll_create1(EPOLL_CLOEXEC);
+	if (fdEpoll < 0)
+	{
+		wrnLog("could not create epoll instance: %s", strerror(errno));
+		curl_multi_cleanup(pCurlMulti);
+		return NULL;
+	}
+
+	curl_multi_setopt(pCurlMulti, CURLMOPT_SOCKETFUNCTION, curlSocketSet);
+	curl_multi_setopt(pCurlMulti, CURLMOPT_TIMERFUNCTION, curlTimerSet);
+#endif
+	dbgLog("global init curl multi done");
+
+	return pCurlMulti;
+}
+
+/*
+ * Literature
+ * - https://curl.se/mail/lib-2016-09/0047.html
+ * - https://rachelbythebay.com/w/2012/12/14/quiet/
+ */
+void CurlMultiplexing::multiDeInit()
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mtxMulti);
+#endif
+	unordered_map<CURL *, CurlBinding>::iterator iter;
+
+	if (!pMulti)
+		return;
+
+	// Easy handles are owned by the clients
+	for (iter = bindings.begin(); iter != bindings.end(); ++iter)
+		curl_multi_remove_handle(pMulti, iter->first);
+
+	bindings.clear();
+
+	curl_multi_cleanup(pMulti);
+	pMulti = NULL;
+#if defined(__linux__)
+	if (fdEpoll >= 0)
+	{
+		::close(fdEpoll);
+		fdEpoll = -1;
+	}
+
+	timerActive = false;
+#endif
+	dbgLog("global deinit curl multi done");
+}
+
+/*
+ * Only sockets with pending events and expired
+ * timers are handed to cURL. Idle transfers cost
+ * a single epoll_wait() per cycle
+ *
+ * Literature
+ * - https://curl.se/libcurl/c/curl_multi_socket_action.html
+ * - https://curl.se/libcurl/c/ephiperfifo.html
+ * - https://man7.org/linux/man-pages/man2/epoll_wait.2.html
+ */
+void CurlMultiplexing::multiProcess()
+{
+	int numRunning;
+
+	if (!pMulti)
+		return;
+#if defined(__linux__)
+	struct epoll_event events[cNumEventsMax];
+	int numEvents, i, flags;
+
+	numEvents = epoll_wait(fdEpoll, events, cNumEventsMax, 0);
+
+	for (i = 0; i < numEvents; ++i)
+	{
+		flags = 0;
+
+		if (events[i].events & EPOLLIN)
+			flags |= CURL_CSELECT_IN;
+		if (events[i].events & EPOLLOUT)
+			flags |= CURL_CSELECT_OUT;
+		if (events[i].events & (EPOLLERR | EPOLLHUP))
+			flags |= CURL_CSELECT_ERR;
+
+		curl_multi_socket_action(pMulti, events[i].data.fd, flags, &numRunning);
+	}
+
+	if (timerActive && millis() - msTimerStart >= msTimerDuration)
+	{
+		timerActive = false;
+		curl_multi_socket_action(pMulti, CURL_SOCKET_TIMEOUT, 0, &numRunning);
+	}
+#else
+	curl_multi_perform(pMulti, &numRunning);
+#endif
+	transfersDoneDispatch();
+}
+
+/*
+ * Literature
+ * - https://curl.se/libcurl/c/curl_multi_info_read.html
+ */
+void CurlMultiplexing::transfersDoneDispatch()
+{
+	unordered_map<CURL *, CurlBinding>::iterator iter;
+	CurlBinding binding;
+	CURLMsg *curlMsg;
+	int numMsgsLeft;
+	CURL *pCurl;
+	CURLcode res;
+
+	while (curlMsg = curl_multi_info_read(pMulti, &numMsgsLeft), curlMsg)
+	{
+		if (curlMsg->msg != CURLMSG_DONE)
+			continue;
+
+		pCurl = curlMsg->easy_handle;
+		res = curlMsg->data.result;
+
+		// Message is invalid after removal
+		curl_multi_remove_handle(pMulti, pCurl);
+
+		iter = bindings.find(pCurl);
+		if (iter == bindings.end())
+			continue;
+
+		binding = iter->second;
+		bindings.erase(iter);
+
+		if (binding.pFctDone)
+			binding.pFctDone(pCurl, res, binding.pUser);
+	}
+}
+
+#if defined(__linux__)
+extern "C" int CurlMultiplexing::curlSocketSet(CURL *pCurl, curl_socket_t fd, int what, void *pUser, void *pSock)
+{
+	struct epoll_event ev;
+
+	if (what == CURL_POLL_REMOVE)
+	{
+		epoll_ctl(fdEpoll, EPOLL_CTL_DEL, fd, NULL);
+		return 0;
+	}
+
+	ev.events = 0;
+	ev.data.fd = fd;
+
+	if (what & CURL_POLL_IN)
+		ev.events |= EPOLLIN;
+	if (what & CURL_POLL_OUT)
+		ev.events |= EPOLLOUT;
+
+	if (!epoll_ctl(fdEpoll, EPOLL_CTL_MOD, fd, &ev))
+		return 0;
+
+	if (errno != ENOENT)
+		return errLog(-1, "could not modify socket %d in epoll: %s", fd, strerror(errno));
+
+	if (epoll_ctl(fdEpoll, EPOLL_CTL_ADD, fd, &ev))
+		return errLog(-1, "could not add socket %d to epoll: %s", fd, strerror(errno));
+
+	return 0;
+}
+
+/*
+ * A timeout of zero is handled in the next cycle
+ */
+extern "C" int CurlMultiplexing::curlTimerSet(CURLM *pCurlMulti, long msTimeout, void *pUser)
+{
+	if (msTimeout < 0)
+	{
+		timerActive = false;
+		return 0;
+	}
+
+	timerActive = true;
+	msTimerStart = millis();
+	msTimerDuration = msTimeout;
+
+	return 0;
+}
+#endif
+
@@ -0,0 +1,108 @@
+/*
+  This file is part of the DSP-Crowd project
+  https://www.dsp-crowd.com
+
+  Author(s):
+      - Johannes Natter, office@dsp-crowd.com
+
+  File created on 19.10.2026
+
+  Copyright (C) 2026, Johannes Natter
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CURL_MULTIPLEXING_H
+#define CURL_MULTIPLEXING_H
+
+#include <unordered_map>
+
+#include "Processing.h"
+#include "LibDspc.h"
+
+typedef void (*FuncCurlDone)(CURL *pCurl, CURLcode res, void *pUser);
+
+struct CurlBinding
+{
+	FuncCurlDone pFctDone;
+	void *pUser;
+};
+
+class CurlMultiplexing : public Processing
+{
+
+public:
+
+	static CurlMultiplexing *create()
+	{
+		return new dNoThrow CurlMultiplexing;
+	}
+
+	static Success easyAdd(CURL *pCurl, FuncCurlDone pFctDone, void *pUser);
+	static void easyRemove(CURL *pCurl);
+	static void transfersProcess();
+	static size_t numTransfers();
+
+protected:
+
+	virtual ~CurlMultiplexing() {}
+
+private:
+
+	CurlMultiplexing();
+	CurlMultiplexing(const CurlMultiplexing &) = delete;
+	CurlMultiplexing &operator=(const CurlMultiplexing &) = delete;
+
+	/*
+	 * Naming of functions:  objectVerb()
+	 * Example:              peerAdd()
+	 */
+
+	/* member functions */
+	Success process();
+	Success shutdown();
+	void processInfo(char *pBuf, char *pBufEnd);
+
+	/* member variables */
+	uint32_t mStateSd;
+	bool mIsEngine;
+
+	/* static functions */
+	static CURLM *multiInit();
+	static void multiDeInit();
+	static void multiProcess();
+	static void transfersDoneDispatch();
+#if defined(__linux__)
+	static int curlSocketSet(CURL *pCurl, curl_socket_t fd, int what, void *pUser, void *pSock);
+	static int curlTimerSet(CURLM *pCurlMulti, long msTimeout, void *pUser);
+#endif
+
+	/* static variables */
+	static std::mutex mtxMulti;
+	static CURLM *pMulti;
+	static bool enginePresent;
+	static std::unordered_map<CURL *, CurlBinding> bindings;
+#if defined(__linux__)
+	static int fdEpoll;
+	static bool timerActive;
+	static uint32_t msTimerStart;
+	static uint32_t msTimerDuration;
+#endif
+
+	/* constants */
+
+};
+
+#endif
+
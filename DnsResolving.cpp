@@ -52,10 +52,15 @@ DnsResolving::DnsResolving()
 	//, mStartMs(0)
 	, mStateSd(StSdStart)
 	, mHostname("")
+	, mLstServers()
+	, mMsTimeoutTry(dDnsDefaultTimeoutTryMs)
+	, mNumTries(dDnsDefaultTries)
+	, mRotate(false)
+	, mFamily(AF_UNSPEC)
+	, mRecursion(true)
+	, mRace(false)
 #if CONFIG_LIB_DSPC_HAVE_C_ARES
-	, mOptionsAres()
-	, mChannelAres()
-	, mChannelAresInitDone(false)
+	, mLstQueriesAres()
 	, mDoneAres(Pending)
 	, mErrAres("")
 #endif
@@ -116,12 +121,11 @@ Success DnsResolving::process()
 		if (mDoneAres == Pending)
 			break;
 
+		aresChannelsDestroy();
+
 		if (mDoneAres != Positive)
 			return procErrLog(-1, "could not finish async address resolution: %s",
 									mErrAres.c_str());
-
-		ares_destroy(mChannelAres);
-		mChannelAresInitDone = false;
 #endif
 		return Positive;
 
@@ -140,11 +144,7 @@ Success DnsResolving::shutdown()
 	case StSdStart:
 
 #if CONFIG_LIB_DSPC_HAVE_C_ARES
-		if (mChannelAresInitDone)
-		{
-			ares_destroy(mChannelAres);
-			mChannelAresInitDone = false;
-		}
+		aresChannelsDestroy();
 #endif
 		return Positive;
 
@@ -157,47 +157,124 @@ Success DnsResolving::shutdown()
 }
 
 #if CONFIG_LIB_DSPC_HAVE_C_ARES
+/*
+ * Racing
+ * - Every configured server gets its own channel and query
+ * - First positive answer wins. Remaining queries are dropped
+ * - Only fails if all queries failed
+ * - A single unresponsive server no longer consumes the whole timeout budget
+ */
+bool DnsResolving::aresStart()
+{
+	list<string>::const_iterator iter;
+	DnsQueryAres query;
+	bool ok;
+
+	query.pReq = this;
+	query.servers = "";
+	query.channel = NULL;
+	query.channelInitDone = false;
+	query.done = Pending;
+	query.err = "";
+
+	if (mRace && mLstServers.size() > 1)
+	{
+		iter = mLstServers.begin();
+		for (; iter != mLstServers.end(); ++iter)
+		{
+			query.servers = *iter;
+			mLstQueriesAres.push_back(query);
+		}
+	}
+	else
+	{
+		iter = mLstServers.begin();
+		for (; iter != mLstServers.end(); ++iter)
+		{
+			if (query.servers.size())
+				query.servers.push_back(',');
+
+			query.servers += *iter;
+		}
+
+		mLstQueriesAres.push_back(query);
+	}
+
+	list<DnsQueryAres>::iterator iQuery;
+
+	iQuery = mLstQueriesAres.begin();
+	for (; iQuery != mLstQueriesAres.end(); ++iQuery)
+	{
+		ok = aresQueryStart(*iQuery);
+		if (!ok)
+			return false;
+
+		if (mDoneAres != Pending)
+			break;
+	}
+
+	return true;
+}
+
 /*
  * Literature
  * - https://c-ares.org/docs.html
  * - https://c-ares.org/docs/ares_init_options.html
+ * - https://c-ares.org/docs/ares_set_servers_ports_csv.html
  * - https://c-ares.org/docs/ares_getaddrinfo.html
  * - https://man7.org/linux/man-pages/man3/getaddrinfo.3.html
  * - https://c-ares.org/docs/ares_freeaddrinfo.html
  */
-bool DnsResolving::aresStart()
+bool DnsResolving::aresQueryStart(DnsQueryAres &query)
 {
-	int res;
+	ares_options optionsAres;
+	int optMask, res;
+
+	memset(&optionsAres, 0, sizeof(optionsAres));
+
+	optMask = ARES_OPT_FLAGS | ARES_OPT_TIMEOUTMS | ARES_OPT_TRIES;
 
-	memset(&mOptionsAres, 0, sizeof(mOptionsAres));
+	optionsAres.flags = mRecursion ? 0 : ARES_FLAG_NORECURSE;
+	optionsAres.timeout = mMsTimeoutTry;
+	optionsAres.tries = mNumTries;
 
-	mOptionsAres.flags = ARES_FLAG_NORECURSE;
-	mOptionsAres.timeout = 400;
-	mOptionsAres.tries = 2;
+	if (mRotate)
+		optMask |= ARES_OPT_ROTATE;
 
-	res = ares_init_options(&mChannelAres, &mOptionsAres, ARES_OPT_TIMEOUTMS | ARES_OPT_TRIES);
+	res = ares_init_options(&query.channel, &optionsAres, optMask);
 	if (res != ARES_SUCCESS)
 	{
 		procErrLog(-1, "could not set ares options");
 		return false;
 	}
 
+	query.channelInitDone = true;
+
+	if (query.servers.size())
+	{
+		res = ares_set_servers_ports_csv(query.channel, query.servers.c_str());
+		if (res != ARES_SUCCESS)
+		{
+			procErrLog(-1, "could not set DNS servers '%s': %s",
+						query.servers.c_str(), ares_strerror(res));
+			return false;
+		}
+	}
+
 	ares_addrinfo_hints hints;
 
 	memset(&hints, 0, sizeof(hints));
 
 	hints.ai_flags = 0;
-	hints.ai_family = AF_UNSPEC; /* IPv4 / IPv6 */
+	hints.ai_family = mFamily; /* AF_UNSPEC = IPv4 / IPv6 */
 	hints.ai_socktype = 0; /* Any */
 	hints.ai_protocol = 0; /* Any */
 
 	//procWrnLog("Getting address of: %s", mHostname.c_str());
 
-	ares_getaddrinfo(mChannelAres,
+	ares_getaddrinfo(query.channel,
 					mHostname.c_str(), NULL, &hints,
-					aresRequestDone, this);
-
-	mChannelAresInitDone = true;
+					aresRequestDone, &query);
 
 	return true;
 }
@@ -213,19 +290,42 @@ bool DnsResolving::aresStart()
  */
 void DnsResolving::aresProcess()
 {
-	if (!mChannelAresInitDone)
+	if (mDoneAres != Pending)
+		return;
+
+	if (!mLstQueriesAres.size())
 	{
 		mDoneAres = -1;
 		return;
 	}
 
+	list<DnsQueryAres>::iterator iter;
 	fd_set fdsRead, fdsWrite;
-	int fdsMax, res;
+	int fdsMax = 0, fdsMaxQuery, res;
+	struct timeval tmoSelect, tmoQuery, *pTmo;
 
 	FD_ZERO(&fdsRead);
 	FD_ZERO(&fdsWrite);
 
-	fdsMax = ares_fds(mChannelAres, &fdsRead, &fdsWrite);
+	tmoSelect.tv_sec = 0;
+	tmoSelect.tv_usec = 5000;
+
+	iter = mLstQueriesAres.begin();
+	for (; iter != mLstQueriesAres.end(); ++iter)
+	{
+		if (!iter->channelInitDone || iter->done != Pending)
+			continue;
+
+		fdsMaxQuery = ares_fds(iter->channel, &fdsRead, &fdsWrite);
+		if (fdsMaxQuery > fdsMax)
+			fdsMax = fdsMaxQuery;
+
+		pTmo = ares_timeout(iter->channel, &tmoSelect, &tmoQuery);
+		tmoSelect = *pTmo;
+	}
+
+	pTmo = &tmoSelect;
+
 	if (!fdsMax)
 	{
 		mDoneAres = procErrLog(-1, "no file descriptors to be processed");
@@ -238,13 +338,6 @@ void DnsResolving::aresProcess()
 		return;
 	}
 
-	struct timeval tmoSelect, *pTmo;
-
-	tmoSelect.tv_sec = 0;
-	tmoSelect.tv_usec = 5000;
-
-	pTmo = ares_timeout(mChannelAres, &tmoSelect, &tmoSelect);
-
 	res = select(fdsMax, &fdsRead, &fdsWrite, NULL, pTmo);
 	if (res < 0)
 	{
@@ -252,7 +345,39 @@ void DnsResolving::aresProcess()
 		return;
 	}
 
-	ares_process(mChannelAres, &fdsRead, &fdsWrite);
+	iter = mLstQueriesAres.begin();
+	for (; iter != mLstQueriesAres.end(); ++iter)
+	{
+		if (!iter->channelInitDone || iter->done != Pending)
+			continue;
+
+		ares_process(iter->channel, &fdsRead, &fdsWrite);
+
+		if (mDoneAres != Pending)
+			break;
+	}
+}
+
+/*
+ * Literature
+ * - https://c-ares.org/docs/ares_destroy.html
+ */
+void DnsResolving::aresChannelsDestroy()
+{
+	list<DnsQueryAres>::iterator iter;
+
+	iter = mLstQueriesAres.begin();
+	for (; iter != mLstQueriesAres.end(); ++iter)
+	{
+		if (!iter->channelInitDone)
+			continue;
+
+		// Pending queries are finished with ARES_EDESTRUCTION
+		ares_destroy(iter->channel);
+		iter->channelInitDone = false;
+	}
+
+	mLstQueriesAres.clear();
 }
 #endif
 
@@ -261,6 +386,54 @@ void DnsResolving::hostnameSet(const string &hostname)
 	mHostname = hostname;
 }
 
+// Format: host[:port]. IPv6 with port: [host]:port
+void DnsResolving::serverAdd(const string &server)
+{
+	if (!server.size())
+		return;
+
+	mLstServers.push_back(server);
+}
+
+void DnsResolving::msTimeoutTrySet(uint32_t msTimeout)
+{
+	if (!msTimeout)
+		return;
+
+	mMsTimeoutTry = msTimeout;
+}
+
+void DnsResolving::triesSet(uint32_t tries)
+{
+	if (!tries)
+		return;
+
+	mNumTries = tries;
+}
+
+void DnsResolving::rotateSet(bool rotate)
+{
+	mRotate = rotate;
+}
+
+void DnsResolving::familySet(int family)
+{
+	if (family != AF_UNSPEC && family != AF_INET && family != AF_INET6)
+		return;
+
+	mFamily = family;
+}
+
+void DnsResolving::recursionSet(bool recursion)
+{
+	mRecursion = recursion;
+}
+
+void DnsResolving::raceSet(bool race)
+{
+	mRace = race;
+}
+
 const list<string> &DnsResolving::lstIPv4()
 {
 	return mLstIPv4;
@@ -276,6 +449,9 @@ void DnsResolving::processInfo(char *pBuf, char *pBufEnd)
 #if 1
 	dInfo("State\t\t\t%s\n", ProcStateString[mState]);
 #endif
+#if CONFIG_LIB_DSPC_HAVE_C_ARES
+	dInfo("Queries\t\t\t%zu\n", mLstQueriesAres.size());
+#endif
 }
 
 /* static functions */
@@ -288,14 +464,37 @@ void DnsResolving::processInfo(char *pBuf, char *pBufEnd)
  */
 void DnsResolving::aresRequestDone(void *arg, int status, int timeouts, struct ares_addrinfo *result)
 {
-	DnsResolving *pReq = (DnsResolving *)arg;
+	DnsQueryAres *pQuery = (DnsQueryAres *)arg;
+	DnsResolving *pReq = pQuery->pReq;
+
+	if (pReq->mDoneAres != Pending)
+	{
+		// Race already decided
+		pQuery->done = -1;
+
+		ares_freeaddrinfo(result);
+		return;
+	}
 
 	if (status)
 	{
-		pReq->mErrAres = ares_strerror(status);
-		pReq->mDoneAres = -1;
+		pQuery->err = ares_strerror(status);
+		pQuery->done = -1;
 
 		ares_freeaddrinfo(result);
+
+		list<DnsQueryAres>::iterator iter;
+
+		iter = pReq->mLstQueriesAres.begin();
+		for (; iter != pReq->mLstQueriesAres.end(); ++iter)
+		{
+			if (iter->done == Pending)
+				return;
+		}
+
+		pReq->mErrAres = pQuery->err;
+		pReq->mDoneAres = -1;
+
 		return;
 	}
 
@@ -336,6 +535,7 @@ void DnsResolving::aresRequestDone(void *arg, int status, int timeouts, struct a
 		//wrnLog("Addr: %s", bAddr);
 	}
 
+	pQuery->done = Positive;
 	pReq->mDoneAres = Positive;
 
 	ares_freeaddrinfo(result);
@@ -32,6 +32,23 @@
 #include "Processing.h"
 #include "LibDspc.h"
 
+#define dDnsDefaultTimeoutTryMs		400
+#define dDnsDefaultTries			2
+
+class DnsResolving;
+
+#if CONFIG_LIB_DSPC_HAVE_C_ARES
+struct DnsQueryAres
+{
+	DnsResolving *pReq;
+	std::string servers;
+	ares_channel channel;
+	bool channelInitDone;
+	Success done;
+	std::string err;
+};
+#endif
+
 class DnsResolving : public Processing
 {
 
@@ -44,6 +61,13 @@ public:
 
 	// input
 	void hostnameSet(const std::string &hostname);
+	void serverAdd(const std::string &server);
+	void msTimeoutTrySet(uint32_t msTimeout);
+	void triesSet(uint32_t tries);
+	void rotateSet(bool rotate);
+	void familySet(int family);
+	void recursionSet(bool recursion);
+	void raceSet(bool race);
 
 	// output
 	const std::list<std::string> &lstIPv4();
@@ -71,19 +95,26 @@ private:
 
 #if CONFIG_LIB_DSPC_HAVE_C_ARES
 	bool aresStart();
+	bool aresQueryStart(DnsQueryAres &query);
 	void aresProcess();
+	void aresChannelsDestroy();
 #endif
 	/* member variables */
 	//uint32_t mStartMs;
 	uint32_t mStateSd;
 	std::string mHostname;
+	std::list<std::string> mLstServers;
+	uint32_t mMsTimeoutTry;
+	uint32_t mNumTries;
+	bool mRotate;
+	int mFamily;
+	bool mRecursion;
+	bool mRace;
 	std::list<std::string> mLstIPv4;
 	std::list<std::string> mLstIPv6;
 
 #if CONFIG_LIB_DSPC_HAVE_C_ARES
-	ares_options mOptionsAres;
-	ares_channel mChannelAres;
-	bool mChannelAresInitDone;
+	std::list<DnsQueryAres> mLstQueriesAres;
 	Success mDoneAres;
 	std::string mErrAres;
 #endif
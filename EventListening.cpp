@@ -23,52 +23,163 @@
   along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#if defined(__linux__)
+#include <chrono>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#endif
+
 #include "EventListening.h"
 #include "LibDspc.h"
 
 #define dForEach_ProcState(gen) \
 		gen(StStart) \
 		gen(StMain) \
+		gen(StEpollStart) \
+		gen(StEpollMain) \
 		gen(StTmp) \
 
 #define dGenProcStateEnum(s) s,
 dProcessStateEnum(ProcState);
 
+#define dForEach_SdState(gen) \
+		gen(StSdStart) \
+
+#define dGenSdStateEnum(s) s,
+dProcessStateEnum(SdState);
+
 #if 1
 #define dGenProcStateString(s) #s,
 dProcessStateStr(ProcState);
 #endif
 
 using namespace std;
+using namespace chrono;
 using namespace Json;
 
-#if CONFIG_PROC_HAVE_DRIVERS
-mutex EventListening::mMtxEvents;
-#endif
-map<string, Value> EventListening::mEvents;
+EventShard EventListening::mShards[dEventNumShards];
+atomic<size_t> EventListening::mSizeStore(0);
+thread_local EventSubscription *EventListening::mpSubDelivering = NULL;
 
 const uint32_t cMsDelayDataMax = 300;
 const uint32_t cNumOpenConnsMax = 10;
 const uint32_t cMsDelayDequeueMax = 600;
+const uint32_t cMsDelayIdleMax = 60000;
+const uint16_t cPortListen = 4050;
+const size_t cSizeMsgMax = 65536;
+const size_t cSizeBufConnInit = 512;
+const size_t cNumReadsBurstMax = 64;
+const size_t cSizeStoreMax = 8 << 20;
+const size_t cNumQueueMaxDefault = 64;
+const size_t cSizeHdrMax = 6;
+#if defined(__linux__)
+const uint32_t cNumOpenConnsEpollMax = 4096;
+const int cNumEpollEventsMax = 256;
+#endif
 
 EventListening::EventListening()
 	: Processing("EventListening")
 	//, mStartMs(0)
+	, mStateSd(StSdStart)
 	, mpLst(NULL)
-	, mLenBuf(0)
+	, mModeEpoll(false)
+	, mFraming(EvFramingNone)
+	, mPort(cPortListen)
+	, mNumConnsMax(0)
+	, mMsTimeoutData(cMsDelayDataMax)
+	, mMsTimeoutIdle(cMsDelayIdleMax)
+	, mMsTimeoutDequeue(cMsDelayDequeueMax)
+	, mSizeMsgMax(cSizeMsgMax)
+	, mSizeStoreMax(cSizeStoreMax)
+	, mSizeHigh(0)
+	, mSizeLow(0)
+	, mPaused(false)
+#if defined(__linux__)
+	, mFdLst(-1)
+	, mFdEpoll(-1)
+	, mConnsEpoll()
+	, mLstConnsIdle()
+#endif
+	, mNumEventsRcvd(0)
+	, mNumEventsDropped(0)
+	, mMsStats(0)
+	, mNumEventsStats(0)
+	, mEventsPerSec(0)
+	, mUsRcvd(0)
+	, mUsLatencyP99(0)
 {
 	mBuf[0] = 0;
+	memset(mNumsLatency, 0, sizeof(mNumsLatency));
 
 	mState = StStart;
 }
 
 /* member functions */
 
+void EventListening::epollModeSet(bool en)
+{
+	mModeEpoll = en;
+}
+
+void EventListening::framingSet(EventFraming framing)
+{
+	mFraming = framing;
+}
+
+void EventListening::portSet(uint16_t port)
+{
+	mPort = port;
+}
+
+// 0: Default of the selected mode
+void EventListening::numConnsMaxSet(size_t numConnsMax)
+{
+	mNumConnsMax = numConnsMax;
+}
+
+void EventListening::msTimeoutDataSet(uint32_t msTimeout)
+{
+	mMsTimeoutData = msTimeout;
+}
+
+void EventListening::msTimeoutIdleSet(uint32_t msTimeout)
+{
+	mMsTimeoutIdle = msTimeout;
+}
+
+void EventListening::msTimeoutDequeueSet(uint32_t msTimeout)
+{
+	mMsTimeoutDequeue = msTimeout;
+}
+
+void EventListening::sizeMsgMaxSet(size_t sizeMax)
+{
+	mSizeMsgMax = sizeMax;
+}
+
+void EventListening::sizeStoreMaxSet(size_t sizeMax)
+{
+	mSizeStoreMax = sizeMax;
+}
+
+/*
+ * Ingestion is paused when the store reaches sizeHigh
+ * and resumed when it falls to sizeLow.
+ * 0: Derived from the maximum store size
+ */
+void EventListening::watermarksSet(size_t sizeHigh, size_t sizeLow)
+{
+	mSizeHigh = sizeHigh;
+	mSizeLow = sizeLow;
+}
+
 Success EventListening::process()
 {
 	//uint32_t curTimeMs = millis();
 	//uint32_t diffMs = curTimeMs - mStartMs;
-	//Success success;
+	Success success;
 #if 0
 	dStateTrace;
 #endif
@@ -76,24 +187,73 @@ Success EventListening::process()
 	{
 	case StStart:
 
-		mpLst = TcpListening::create();
-		if (!mpLst)
-			procErrLog(-1, "could not create process");
+		mMsStats = millis();
+
+		if (!mNumConnsMax)
+			mNumConnsMax = mModeEpoll ? cNumOpenConnsEpollMax : cNumOpenConnsMax;
+
+		if (!mSizeHigh)
+			mSizeHigh = mSizeStoreMax / 4 * 3;
+
+		if (!mSizeLow || mSizeLow > mSizeHigh)
+			mSizeLow = mSizeHigh / 3 * 2;
 
-		mpLst->portSet(4050, true);
-		//mpLst->procTreeDisplaySet(true);
+		if (mModeEpoll)
+		{
+			mState = StEpollStart;
+			break;
+		}
 
-		start(mpLst);
+		success = listenerStart();
+		if (success != Positive)
+			return success;
 
 		mState = StMain;
 
 		break;
 	case StMain:
 
-		connectionsAccept();
-		dataTimeoutsCheck();
-		dataReceive();
+		success = backpressureUpdate();
+		if (success != Positive)
+			return success;
+
+		if (!mPaused)
+		{
+			connectionsAccept();
+			dataTimeoutsCheck();
+			dataReceive();
+		}
+
+		dequeueTimeoutsCheck();
+		statsUpdate();
+
+		break;
+	case StEpollStart:
+
+#if defined(__linux__)
+		success = epollStart();
+		if (success != Positive)
+			return procErrLog(-1, "could not start epoll mode");
+#else
+		return procErrLog(-1, "epoll mode not supported on this platform");
+#endif
+		mState = StEpollMain;
+
+		break;
+	case StEpollMain:
+
+		success = backpressureUpdate();
+		if (success != Positive)
+			return success;
+#if defined(__linux__)
+		if (!mPaused)
+		{
+			epollEventsProcess();
+			epollDataTimeoutsCheck();
+		}
+#endif
 		dequeueTimeoutsCheck();
+		statsUpdate();
 
 		break;
 	case StTmp:
@@ -106,6 +266,59 @@ Success EventListening::process()
 	return Pending;
 }
 
+Success EventListening::shutdown()
+{
+#if defined(__linux__)
+	map<int, EventConnEpoll>::iterator iter;
+#endif
+	switch (mStateSd)
+	{
+	case StSdStart:
+
+#if defined(__linux__)
+		iter = mConnsEpoll.begin();
+		for (; iter != mConnsEpoll.end(); ++iter)
+			::close(iter->first);
+
+		mConnsEpoll.clear();
+		mLstConnsIdle.clear();
+
+		if (mFdEpoll >= 0)
+		{
+			::close(mFdEpoll);
+			mFdEpoll = -1;
+		}
+
+		if (mFdLst >= 0)
+		{
+			::close(mFdLst);
+			mFdLst = -1;
+		}
+#endif
+		return Positive;
+
+		break;
+	default:
+		break;
+	}
+
+	return Pending;
+}
+
+Success EventListening::listenerStart()
+{
+	mpLst = TcpListening::create();
+	if (!mpLst)
+		return procErrLog(-1, "could not create process");
+
+	mpLst->portSet(mPort, true);
+	//mpLst->procTreeDisplaySet(true);
+
+	start(mpLst);
+
+	return Positive;
+}
+
 void EventListening::connectionsAccept()
 {
 	PipeEntry<int> peerFdEntry;
@@ -113,38 +326,46 @@ void EventListening::connectionsAccept()
 	TcpTransfering *pConn;
 	OpenEventConn openConn;
 
-	if (mpLst->ppPeerFd.get(peerFdEntry) < 1)
-		return;
-	peerFd = peerFdEntry.particle;
-
-	if (mConnsOpen.size() >= cNumOpenConnsMax)
+	while (mpLst->ppPeerFd.get(peerFdEntry) > 0)
 	{
-		procErrLog(-1, "reached max open connections. Conn dropped");
-		::close(peerFd);
-		return;
-	}
+		peerFd = peerFdEntry.particle;
 
-	pConn = TcpTransfering::create(peerFd);
-	if (!pConn)
-	{
-		procErrLog(-1, "could not create process");
-		::close(peerFd);
-		return;
-	}
+		if (mConnsOpen.size() >= mNumConnsMax)
+		{
+			procErrLog(-1, "reached max open connections. Conn dropped");
+			::close(peerFd);
+			continue;
+		}
+
+		pConn = TcpTransfering::create(peerFd);
+		if (!pConn)
+		{
+			procErrLog(-1, "could not create process");
+			::close(peerFd);
+			continue;
+		}
 
-	pConn->procTreeDisplaySet(false);
+		pConn->procTreeDisplaySet(false);
 
-	start(pConn);
+		start(pConn);
 
-	openConn.msStart = millis();
-	openConn.pConn = pConn;
+		openConn.msStart = millis();
+		openConn.pConn = pConn;
+		openConn.buf = RingBuffer(cSizeBufConnInit, sizeBufConnMax());
+		openConn.offsScan = 0;
 
-	mConnsOpen.push_back(openConn);
+		mConnsOpen.push_back(openConn);
+	}
 }
 
+/*
+ * Open connections are ordered by their last activity.
+ * Only the expired ones at the front are visited
+ */
 void EventListening::dataTimeoutsCheck()
 {
 	uint32_t curTimeMs = millis();
+	uint32_t msDelayMax = mFraming == EvFramingNone ? mMsTimeoutData : mMsTimeoutIdle;
 	list<OpenEventConn>::iterator iter;
 	uint32_t diffMs;
 
@@ -152,11 +373,8 @@ void EventListening::dataTimeoutsCheck()
 	while (iter != mConnsOpen.end())
 	{
 		diffMs = curTimeMs - iter->msStart;
-		if (diffMs < cMsDelayDataMax)
-		{
-			++iter;
-			continue;
-		}
+		if (diffMs < msDelayMax)
+			break;
 
 		procErrLog(-1, "data rcv timeout reached. Conn dropped");
 
@@ -168,17 +386,30 @@ void EventListening::dataTimeoutsCheck()
 
 void EventListening::dataReceive()
 {
-	list<OpenEventConn>::iterator iter;
+	list<OpenEventConn> connsActive;
+	list<OpenEventConn>::iterator iter, iterNext;
+	uint32_t msStart;
 	Success success;
 
 	iter = mConnsOpen.begin();
 	while (iter != mConnsOpen.end())
 	{
-		success = msgEnqueue(iter->pConn);
+		msStart = iter->msStart;
+
+		if (mFraming == EvFramingNone)
+			success = msgReceive(*iter);
+		else
+			success = framesReceive(*iter);
 
 		if (success == Pending)
 		{
-			++iter;
+			iterNext = iter;
+			++iterNext;
+
+			if (iter->msStart != msStart)
+				connsActive.splice(connsActive.end(), mConnsOpen, iter);
+
+			iter = iterNext;
 			continue;
 		}
 
@@ -186,34 +417,105 @@ void EventListening::dataReceive()
 
 		iter = mConnsOpen.erase(iter);
 	}
+
+	mConnsOpen.splice(mConnsOpen.end(), connsActive);
+}
+
+/*
+ * Messages may span multiple reads.
+ * The data timeout still counts from the connect
+ */
+Success EventListening::msgReceive(OpenEventConn &conn)
+{
+	ssize_t lenRead;
+	size_t lenWritten;
+	bool eof = false;
+
+	for (size_t i = 0; i < cNumReadsBurstMax; ++i)
+	{
+		lenRead = conn.pConn->read(mBuf, sizeof(mBuf));
+		if (!lenRead)
+			break;
+
+		if (lenRead < 0)
+		{
+			eof = true;
+			break;
+		}
+#if 0
+		procWrnLog("received data. len = %zd", lenRead);
+		hexDump(mBuf, lenRead);
+#endif
+		mUsRcvd = usTickGet();
+
+		lenWritten = conn.buf.write(mBuf, lenRead);
+		if (lenWritten != (size_t)lenRead)
+			return procErrLog(-1, "event message too big. Conn dropped");
+	}
+
+	return msgSingleParse(conn.buf, eof);
 }
 
-Success EventListening::msgEnqueue(TcpTransfering *pConn)
+/*
+ * One message per connection.
+ * A JSON object ends with a closing brace, so parsing
+ * is only tried if the data may be complete
+ */
+Success EventListening::msgSingleParse(RingBuffer &buf, bool eof)
 {
-	ssize_t lenReq;
+	const char *pData, *pEnd;
 	Reader jReader;
-	bool ok;
 	Value msgEvent;
-	string refMsg;
+	bool ok;
 
-	lenReq = sizeof(mBuf) - 1;
-	mLenBuf = pConn->read(mBuf, lenReq);
+	if (buf.size() > mSizeMsgMax)
+		return procErrLog(-1, "event message too big. Conn dropped");
 
-	if (!mLenBuf)
-		return Pending;
+	if (!buf.size())
+	{
+		if (!eof)
+			return Pending;
 
-	if (mLenBuf < 0)
 		return procErrLog(-1, "connection lost");
+	}
 
-	mBuf[mLenBuf] = 0;
-#if 0
-	procWrnLog("received data. len = %d", mLenBuf);
-	hexDump(mBuf, mLenBuf);
-#endif
-	ok = jReader.parse(mBuf, mBuf + mLenBuf, msgEvent);
+	pData = buf.linear(buf.size());
+	pEnd = pData + buf.size();
+
+	while (pEnd > pData && isspace((unsigned char)pEnd[-1]))
+		--pEnd;
+
+	if (!eof && (pEnd == pData || pEnd[-1] != '}'))
+		return Pending;
+
+	ok = jReader.parse(pData, pData + buf.size(), msgEvent, false);
+	if (!ok && !eof)
+		return Pending;
+
+	if (!ok)
+		return procErrLog(-1, "could not parse event message");
+
+	return msgEnqueue(msgEvent, buf.size());
+}
+
+Success EventListening::msgEnqueue(const char *pData, size_t len)
+{
+	Reader jReader;
+	bool ok;
+	Value msgEvent;
+
+	ok = jReader.parse(pData, pData + len, msgEvent, false);
 	if (!ok)
 		return procErrLog(-1, "could not parse event message");
 
+	return msgEnqueue(msgEvent, len);
+}
+
+Success EventListening::msgEnqueue(Value &msgEvent, size_t len)
+{
+	string refMsg;
+	EventEntry entry;
+
 	if (!jKeyFind(msgEvent, "refMsg"))
 		return procErrLog(-1, "could not find message reference");
 
@@ -223,13 +525,6 @@ Success EventListening::msgEnqueue(TcpTransfering *pConn)
 	refMsg = msgEvent["refMsg"].asString();
 	msgEvent.removeMember("refMsg");
 
-	{
-#if CONFIG_PROC_HAVE_DRIVERS
-		Guard lock(mMtxEvents);
-#endif
-		msgEvent["msEnqueued"] = millis();
-		mEvents[refMsg] = msgEvent;
-	}
 #if 0
 	{
 		StyledWriter jWriter;
@@ -238,69 +533,1105 @@ Success EventListening::msgEnqueue(TcpTransfering *pConn)
 				refMsg.c_str(), str.c_str());
 	}
 #endif
-	return Positive;
+	entry.msg.swap(msgEvent);
+	entry.parsed = true;
+	entry.size = len;
+
+	return eventStore(refMsg, entry);
 }
 
-// msgDequeue
-ssize_t EventListening::pop(const string &refMsg, Value &msgEvent)
+/*
+ * Binary payloads are stored as received.
+ * Parsing is deferred until a consumer asks for JSON
+ */
+Success EventListening::msgEnqueue(const string &refMsg, const char *pData, size_t len)
+{
+	EventEntry entry;
+
+	if (!refMsg.size())
+		return procErrLog(-1, "message reference is empty");
+
+	entry.data.assign(pData, len);
+	entry.parsed = false;
+	entry.size = len;
+
+	return eventStore(refMsg, entry);
+}
+
+/*
+ * The policy of the reference decides how many events are kept.
+ * Entries pushed out by a new event are released before the
+ * memory limit of the store is checked
+ */
+Success EventListening::eventStore(const string &refMsg, EventEntry &entry)
 {
+	EventShard &shard = shardGet(refMsg);
+	unordered_map<string, EventSubscription>::iterator iSub;
+	unordered_map<string, EventPolicyCfg>::iterator iPol;
+	unordered_map<string, deque<EventEntry> >::iterator iEntries;
+	EventSubscription *pSub = NULL;
+	bool deliver = false;
+	bool queue = false;
+	bool full = false;
+	size_t numEntriesMax = 1;
+	size_t numDropped = 0;
+	size_t sizeFreed = 0;
+
+	++mNumEventsRcvd;
+
+	latencyAdd(usTickGet() - mUsRcvd);
+
+	{
 #if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxEvents);
+		Guard lock(shard.mtx);
 #endif
-	map<string, Value>::iterator iter;
+		iSub = shard.subs.find(refMsg);
+		if (iSub != shard.subs.end() && !iSub->second.removed)
+		{
+			pSub = &iSub->second;
+			deliver = pSub->pFctNotify || pSub->pFctDataNotify;
+		}
 
-	iter = mEvents.find(refMsg);
-	if (iter == mEvents.end())
-		return 0;
+		// Subscription is kept until the callback returned
+		if (deliver)
+			++pSub->numDelivering;
+
+		if (!deliver)
+		{
+			iPol = shard.policies.find(refMsg);
+			if (iPol != shard.policies.end() && iPol->second.policy == EvPolicyQueue)
+			{
+				queue = true;
+				numEntriesMax = iPol->second.numQueueMax;
+			}
+
+			iEntries = shard.events.find(refMsg);
+			if (iEntries != shard.events.end() &&
+					iEntries->second.size() >= numEntriesMax)
+				numDropped = iEntries->second.size() - numEntriesMax + 1;
+
+			for (size_t i = 0; i < numDropped; ++i)
+				sizeFreed += iEntries->second[i].size;
+
+			full = mSizeStore - sizeFreed + entry.size > mSizeStoreMax;
+		}
 
-	msgEvent = iter->second;
-	msgEvent.removeMember("msEnqueued");
+		if (!deliver && !full)
+		{
+			deque<EventEntry> &entries = shard.events[refMsg];
+			EventExpiry expiry;
 
-	mEvents.erase(iter);
+			entries.erase(entries.begin(), entries.begin() + numDropped);
+			entries.push_back(EventEntry());
 
-	return 1;
+			EventEntry &entryStored = entries.back();
+
+			entryStored.msg.swap(entry.msg);
+			entryStored.data.swap(entry.data);
+			entryStored.parsed = entry.parsed;
+			entryStored.size = entry.size;
+			entryStored.msEnqueued = millis();
+			entryStored.id = shard.idNext++;
+
+			mSizeStore += entry.size;
+			mSizeStore -= sizeFreed;
+
+			expiry.refMsg = refMsg;
+			expiry.msEnqueued = entryStored.msEnqueued;
+			expiry.id = entryStored.id;
+
+			shard.expiries.push_back(expiry);
+		}
+#if defined(__linux__)
+		if (!deliver && !full && pSub && pSub->fdNotify >= 0)
+			eventfd_write(pSub->fdNotify, 1);
+#endif
+	}
+
+	// Called without lock. Subscriber may pop() or unsubscribe()
+	if (deliver)
+	{
+		entryDeliver(refMsg, entry, pSub);
+		deliveryFinish(refMsg, pSub);
+		return Positive;
+	}
+
+	if (full)
+	{
+		++mNumEventsDropped;
+		return procErrLog(-1, "event store full. Message dropped");
+	}
+
+	if (queue && numDropped)
+	{
+		mNumEventsDropped += numDropped;
+		procWrnLog("event queue full. Oldest message dropped");
+	}
+
+	return Positive;
 }
 
-void EventListening::dequeueTimeoutsCheck()
+/*
+ * Ingestion is stopped above the high watermark.
+ * Unread data stays in the socket buffers of the kernel
+ * and TCP flow control slows down the producers.
+ * The listener is stopped as well. Connections already
+ * accepted by it are taken over before.
+ * In epoll mode the listening socket just isn't served
+ * and new connections wait in the backlog.
+ * Activity is refreshed on resume so connections
+ * don't time out because of the pause
+ */
+Success EventListening::backpressureUpdate()
 {
-	uint32_t curTimeMs = millis();
-	map<string, Value>::iterator iter;
-	uint32_t msStart;
-	uint32_t diffMs;
+	uint32_t curTimeMs;
+	size_t sizeStore = mSizeStore;
+	Success success;
 
-	iter = mEvents.begin();
-	while (iter != mEvents.end())
+	if (!mPaused)
 	{
-		const Value &msgEvent = iter->second;
-		msStart = msgEvent["msEnqueued"].asUInt();
+		if (sizeStore < mSizeHigh)
+			return Positive;
 
-		diffMs = curTimeMs - msStart;
-		if (diffMs < cMsDelayDequeueMax)
+		procWrnLog("high watermark reached. Ingestion paused");
+		mPaused = true;
+
+		if (mpLst)
 		{
-			++iter;
-			continue;
+			connectionsAccept();
+
+			repel(mpLst);
+			mpLst = NULL;
 		}
 
-		procErrLog(-1, "dequeue timeout reached. Message dropped");
+		return Positive;
+	}
+
+	if (sizeStore > mSizeLow)
+		return Positive;
+
+	procWrnLog("low watermark reached. Ingestion resumed");
+	mPaused = false;
 
-		iter = mEvents.erase(iter);
+	if (!mModeEpoll)
+	{
+		success = listenerStart();
+		if (success != Positive)
+			return success;
 	}
+
+	curTimeMs = millis();
+
+	for (list<OpenEventConn>::iterator iter = mConnsOpen.begin();
+			iter != mConnsOpen.end(); ++iter)
+		iter->msStart = curTimeMs;
+#if defined(__linux__)
+	for (map<int, EventConnEpoll>::iterator iter = mConnsEpoll.begin();
+			iter != mConnsEpoll.end(); ++iter)
+		iter->second.msStart = curTimeMs;
+#endif
+	return Positive;
 }
 
-void EventListening::processInfo(char *pBuf, char *pBufEnd)
+/*
+ * A complete frame and the start of the next one
+ * may arrive with the same read
+ */
+size_t EventListening::sizeBufConnMax() const
 {
-#if 1
-	dInfo("State\t\t\t%s\n", ProcStateString[mState]);
-#endif
-	size_t numEvents;
+	return mSizeMsgMax + cSizeHdrMax + sizeof(mBuf);
+}
+
+Success EventListening::framesReceive(OpenEventConn &conn)
+{
+	ssize_t lenRead;
+	size_t lenWritten;
+	Success success;
+	bool eof = false;
+
+	for (size_t i = 0; i < cNumReadsBurstMax; ++i)
 	{
-#if CONFIG_PROC_HAVE_DRIVERS
-		Guard lock(mMtxEvents);
-#endif
-		numEvents = mEvents.size();
+		lenRead = conn.pConn->read(mBuf, sizeof(mBuf));
+		if (!lenRead)
+			break;
+
+		if (lenRead < 0)
+		{
+			eof = true;
+			break;
+		}
+
+		mUsRcvd = usTickGet();
+
+		lenWritten = conn.buf.write(mBuf, lenRead);
+		if (lenWritten != (size_t)lenRead)
+			return procErrLog(-1, "receive buffer full. Conn dropped");
+
+		conn.msStart = millis();
+
+		success = framesParse(conn.buf, conn.offsScan);
+		if (success != Pending)
+			return success;
 	}
-	dInfo("Messages\t\t\t%zu\n", numEvents);
+
+	if (!eof)
+		return Pending;
+
+	if (conn.buf.size())
+		return procErrLog(-1, "connection closed with incomplete message");
+
+	return Positive;
 }
 
-/* static functions */
+/*
+ * Extracts all complete frames from the connection buffer.
+ * Invalid messages are dropped but the connection is kept.
+ * Scanning for newlines continues where the last call stopped
+ */
+Success EventListening::framesParse(RingBuffer &buf, size_t &offsScan)
+{
+	uint8_t hdr[4];
+	uint8_t hdrBin[6];
+	const char *pFrame;
+	size_t idx, lenFrame, lenRef;
+
+	while (1)
+	{
+		if (mFraming == EvFramingNewline)
+		{
+			idx = buf.find('\n', offsScan);
+			if (idx == RingBuffer::npos)
+			{
+				offsScan = buf.size();
+
+				// Optional carriage return
+				if (buf.size() > mSizeMsgMax + 1)
+					return procErrLog(-1, "event message too big. Conn dropped");
+
+				return Pending;
+			}
+
+			lenFrame = idx;
+			pFrame = buf.linear(lenFrame);
+
+			if (lenFrame && pFrame[lenFrame - 1] == '\r')
+				--lenFrame;
+
+			if (lenFrame)
+				msgEnqueue(pFrame, lenFrame);
+
+			buf.drop(idx + 1);
+			offsScan = 0;
+
+			continue;
+		}
+
+		if (mFraming == EvFramingBinary)
+		{
+			if (buf.peek(hdrBin, sizeof(hdrBin)) < sizeof(hdrBin))
+				return Pending;
+
+			lenRef = (size_t)hdrBin[0] << 8 | (size_t)hdrBin[1];
+			lenFrame = (size_t)hdrBin[2] << 24 |
+					(size_t)hdrBin[3] << 16 |
+					(size_t)hdrBin[4] << 8 |
+					(size_t)hdrBin[5];
+
+			if (!lenRef)
+				return procErrLog(-1, "message reference is empty. Conn dropped");
+
+			if (lenRef + lenFrame > mSizeMsgMax)
+				return procErrLog(-1, "event message too big. Conn dropped");
+
+			if (buf.size() < sizeof(hdrBin) + lenRef + lenFrame)
+				return Pending;
+
+			buf.drop(sizeof(hdrBin));
+			pFrame = buf.linear(lenRef + lenFrame);
+
+			msgEnqueue(string(pFrame, lenRef), pFrame + lenRef, lenFrame);
+
+			buf.drop(lenRef + lenFrame);
+
+			continue;
+		}
+
+		if (buf.peek(hdr, sizeof(hdr)) < sizeof(hdr))
+			return Pending;
+
+		lenFrame = (size_t)hdr[0] << 24 |
+				(size_t)hdr[1] << 16 |
+				(size_t)hdr[2] << 8 |
+				(size_t)hdr[3];
+
+		if (lenFrame > mSizeMsgMax)
+			return procErrLog(-1, "event message too big. Conn dropped");
+
+		if (buf.size() < sizeof(hdr) + lenFrame)
+			return Pending;
+
+		buf.drop(sizeof(hdr));
+		pFrame = buf.linear(lenFrame);
+
+		if (lenFrame)
+			msgEnqueue(pFrame, lenFrame);
+
+		buf.drop(lenFrame);
+	}
+
+	return Pending;
+}
+
+// msgDequeue
+ssize_t EventListening::pop(const string &refMsg, Value &msgEvent)
+{
+	EventEntry entry;
+
+	if (!entryTake(refMsg, entry))
+		return 0;
+
+	// Parsed without lock
+	if (!entryToJson(entry, msgEvent))
+		return -1;
+
+	return 1;
+}
+
+/*
+ * Raw bytes are handed out without copying.
+ * Events received as JSON are serialized
+ */
+ssize_t EventListening::pop(const string &refMsg, string &data)
+{
+	EventEntry entry;
+
+	if (!entryTake(refMsg, entry))
+		return 0;
+
+	entryToData(entry, data);
+
+	return 1;
+}
+
+/*
+ * Callback is executed by the driver of EventListening().
+ * Stored events are delivered by subscribe() on the thread of the caller.
+ * Delivered events are not stored and can't be popped
+ */
+bool EventListening::subscribe(const string &refMsg, FuncEventNotify pFctNotify, void *pUser)
+{
+	if (!pFctNotify)
+		return false;
+
+	EventSubscription sub;
+
+	sub.pFctNotify = pFctNotify;
+	sub.pFctDataNotify = NULL;
+	sub.pUser = pUser;
+	sub.fdNotify = -1;
+	sub.numDelivering = 0;
+	sub.removed = false;
+
+	return subscriptionStart(refMsg, sub);
+}
+
+bool EventListening::subscribe(const string &refMsg, FuncEventDataNotify pFctDataNotify, void *pUser)
+{
+	if (!pFctDataNotify)
+		return false;
+
+	EventSubscription sub;
+
+	sub.pFctNotify = NULL;
+	sub.pFctDataNotify = pFctDataNotify;
+	sub.pUser = pUser;
+	sub.fdNotify = -1;
+	sub.numDelivering = 0;
+	sub.removed = false;
+
+	return subscriptionStart(refMsg, sub);
+}
+
+#if defined(__linux__)
+/*
+ * Returns an eventfd which becomes readable when an event
+ * for refMsg has been received. The event must be fetched using pop().
+ * The eventfd is owned by EventListening(). Use unsubscribe() to close it
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man2/eventfd.2.html
+ */
+int EventListening::subscribeFd(const string &refMsg)
+{
+	EventShard &shard = shardGet(refMsg);
+	EventSubscription sub;
+	int fd;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(shard.mtx);
+#endif
+	if (shard.subs.count(refMsg))
+		return -1;
+
+	fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	sub.pFctNotify = NULL;
+	sub.pFctDataNotify = NULL;
+	sub.pUser = NULL;
+	sub.fdNotify = fd;
+	sub.numDelivering = 0;
+	sub.removed = false;
+
+	shard.subs[refMsg] = sub;
+
+	if (shard.events.count(refMsg))
+		eventfd_write(fd, 1);
+
+	return fd;
+}
+#endif
+
+/*
+ * Waits until callbacks in progress have returned.
+ * Afterwards the callback is never executed again
+ * and the user data may be released.
+ * When called from within the callback, only the other
+ * callbacks are waited for. The subscription is then
+ * released when the callback returns
+ */
+void EventListening::unsubscribe(const string &refMsg)
+{
+	EventShard &shard = shardGet(refMsg);
+	unordered_map<string, EventSubscription>::iterator iter;
+	size_t numOwn;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	unique_lock<mutex> lock(shard.mtx);
+#endif
+	iter = shard.subs.find(refMsg);
+	if (iter == shard.subs.end())
+		return;
+
+	if (iter->second.fdNotify >= 0)
+	{
+		::close(iter->second.fdNotify);
+		iter->second.fdNotify = -1;
+	}
+
+	iter->second.removed = true;
+	numOwn = mpSubDelivering == &iter->second ? 1 : 0;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	while (iter->second.numDelivering > numOwn)
+	{
+		shard.cvDelivered.wait(lock);
+
+		// Released by deliveryFinish() or by another unsubscribe()
+		iter = shard.subs.find(refMsg);
+		if (iter == shard.subs.end() || !iter->second.removed)
+			return;
+	}
+#endif
+	if (iter->second.numDelivering)
+		return;
+
+	shard.subs.erase(iter);
+}
+
+/*
+ * EvPolicyOverwrite: Only the latest event is kept (default)
+ * EvPolicyQueue: Up to numQueueMax events are kept. When full, the oldest one is dropped
+ */
+void EventListening::policySet(const string &refMsg, EventPolicy policy, size_t numQueueMax)
+{
+	EventShard &shard = shardGet(refMsg);
+	EventPolicyCfg cfg;
+
+	cfg.policy = policy;
+	cfg.numQueueMax = numQueueMax ? numQueueMax : cNumQueueMaxDefault;
+
+	if (policy == EvPolicyOverwrite)
+		cfg.numQueueMax = 1;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(shard.mtx);
+#endif
+	shard.policies[refMsg] = cfg;
+}
+
+/*
+ * Expiry entries are ordered by enqueue time.
+ * Only the expired ones at the front are visited.
+ * Entries of events which have been popped or
+ * replaced already are skipped using the ID.
+ * Empty queues are never kept in the store
+ */
+void EventListening::dequeueTimeoutsCheck()
+{
+	uint32_t curTimeMs = millis();
+	unordered_map<string, deque<EventEntry> >::iterator iter;
+	uint32_t diffMs;
+
+	for (size_t i = 0; i < dEventNumShards; ++i)
+	{
+		EventShard &shard = mShards[i];
+#if CONFIG_PROC_HAVE_DRIVERS
+		Guard lock(shard.mtx);
+#endif
+		while (shard.expiries.size())
+		{
+			const EventExpiry &expiry = shard.expiries.front();
+
+			diffMs = curTimeMs - expiry.msEnqueued;
+			if (diffMs < mMsTimeoutDequeue)
+				break;
+
+			// Queued events expire in order. Only the oldest one can match
+			iter = shard.events.find(expiry.refMsg);
+			if (iter != shard.events.end() &&
+					iter->second.front().id == expiry.id)
+			{
+				procErrLog(-1, "dequeue timeout reached. Message dropped");
+				++mNumEventsDropped;
+
+				mSizeStore -= iter->second.front().size;
+				iter->second.pop_front();
+
+				if (!iter->second.size())
+					shard.events.erase(iter);
+			}
+
+			shard.expiries.pop_front();
+		}
+	}
+}
+
+#if defined(__linux__)
+/*
+ * Literature
+ * - https://man7.org/linux/man-pages/man7/epoll.7.html
+ * - https://man7.org/linux/man-pages/man2/epoll_create.2.html
+ * - https://man7.org/linux/man-pages/man2/epoll_ctl.2.html
+ * - https://man7.org/linux/man-pages/man2/accept.2.html
+ */
+Success EventListening::epollStart()
+{
+	struct sockaddr_in addr;
+	struct epoll_event ev;
+	int opt = 1;
+	int res;
+
+	mFdLst = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (mFdLst < 0)
+		return procErrLog(-1, "could not create socket: %s", strerror(errno));
+
+	res = ::setsockopt(mFdLst, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+	if (res < 0)
+		return procErrLog(-1, "could not set socket option: %s", strerror(errno));
+
+	memset(&addr, 0, sizeof(addr));
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(mPort);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	res = ::bind(mFdLst, (struct sockaddr *)&addr, sizeof(addr));
+	if (res < 0)
+		return procErrLog(-1, "could not bind socket: %s", strerror(errno));
+
+	res = ::listen(mFdLst, SOMAXCONN);
+	if (res < 0)
+		return procErrLog(-1, "could not listen on socket: %s", strerror(errno));
+
+	mFdEpoll = ::epoll_create1(EPOLL_CLOEXEC);
+	if (mFdEpoll < 0)
+		return procErrLog(-1, "could not create epoll instance: %s", strerror(errno));
+
+	memset(&ev, 0, sizeof(ev));
+
+	ev.events = EPOLLIN;
+	ev.data.fd = mFdLst;
+
+	res = ::epoll_ctl(mFdEpoll, EPOLL_CTL_ADD, mFdLst, &ev);
+	if (res < 0)
+		return procErrLog(-1, "could not add listening socket to epoll: %s", strerror(errno));
+
+	procDbgLog("listening on port %u using epoll", mPort);
+
+	return Positive;
+}
+
+void EventListening::epollEventsProcess()
+{
+	struct epoll_event events[cNumEpollEventsMax];
+	map<int, EventConnEpoll>::iterator iter;
+	Success success;
+	int numEvents, fd;
+
+	numEvents = ::epoll_wait(mFdEpoll, events, cNumEpollEventsMax, 0);
+	if (numEvents < 0)
+	{
+		if (errno != EINTR)
+			procErrLog(-1, "epoll_wait() failed: %s", strerror(errno));
+		return;
+	}
+
+	for (int i = 0; i < numEvents; ++i)
+	{
+		fd = events[i].data.fd;
+
+		if (fd == mFdLst)
+		{
+			epollConnsAccept();
+			continue;
+		}
+
+		iter = mConnsEpoll.find(fd);
+		if (iter == mConnsEpoll.end())
+			continue;
+
+		success = epollDataReceive(iter->second);
+		if (success == Pending)
+			continue;
+
+		epollConnClose(iter);
+	}
+}
+
+void EventListening::epollConnsAccept()
+{
+	struct epoll_event ev;
+	int fd, res;
+
+	memset(&ev, 0, sizeof(ev));
+
+	while (1)
+	{
+		fd = ::accept4(mFdLst, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return;
+
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+
+			procErrLog(-1, "could not accept connection: %s", strerror(errno));
+			return;
+		}
+
+		if (mConnsEpoll.size() >= mNumConnsMax)
+		{
+			procErrLog(-1, "reached max open connections. Conn dropped");
+			::close(fd);
+			continue;
+		}
+
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.fd = fd;
+
+		res = ::epoll_ctl(mFdEpoll, EPOLL_CTL_ADD, fd, &ev);
+		if (res < 0)
+		{
+			procErrLog(-1, "could not add connection to epoll: %s", strerror(errno));
+			::close(fd);
+			continue;
+		}
+
+		EventConnEpoll &conn = mConnsEpoll[fd];
+
+		conn.fd = fd;
+		conn.msStart = millis();
+		conn.buf = RingBuffer(cSizeBufConnInit, sizeBufConnMax());
+		conn.offsScan = 0;
+		conn.iterIdle = mLstConnsIdle.insert(mLstConnsIdle.end(), fd);
+	}
+}
+
+Success EventListening::epollDataReceive(EventConnEpoll &conn)
+{
+	ssize_t lenRead;
+	size_t lenWritten;
+	Success success;
+	bool eof = false;
+
+	for (size_t i = 0; i < cNumReadsBurstMax; ++i)
+	{
+		lenRead = ::read(conn.fd, mBuf, sizeof(mBuf));
+		if (!lenRead)
+		{
+			eof = true;
+			break;
+		}
+
+		if (lenRead < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+
+			if (errno == EINTR)
+				continue;
+
+			return procErrLog(-1, "connection lost");
+		}
+
+		mUsRcvd = usTickGet();
+
+		lenWritten = conn.buf.write(mBuf, lenRead);
+		if (lenWritten != (size_t)lenRead)
+			return procErrLog(-1, "event message too big. Conn dropped");
+
+		if (mFraming == EvFramingNone)
+			continue;
+
+		conn.msStart = millis();
+		mLstConnsIdle.splice(mLstConnsIdle.end(), mLstConnsIdle, conn.iterIdle);
+
+		success = framesParse(conn.buf, conn.offsScan);
+		if (success != Pending)
+			return success;
+	}
+
+	if (mFraming != EvFramingNone)
+	{
+		if (!eof)
+			return Pending;
+
+		if (conn.buf.size())
+			return procErrLog(-1, "connection closed with incomplete message");
+
+		return Positive;
+	}
+
+	return msgSingleParse(conn.buf, eof);
+}
+
+void EventListening::epollConnClose(map<int, EventConnEpoll>::iterator iter)
+{
+	int fd = iter->first;
+
+	::epoll_ctl(mFdEpoll, EPOLL_CTL_DEL, fd, NULL);
+	::close(fd);
+
+	mLstConnsIdle.erase(iter->second.iterIdle);
+	mConnsEpoll.erase(iter);
+}
+
+/*
+ * Connections are ordered by their last activity.
+ * Only the expired ones at the front are visited
+ */
+void EventListening::epollDataTimeoutsCheck()
+{
+	uint32_t curTimeMs = millis();
+	uint32_t msDelayMax = mFraming == EvFramingNone ? mMsTimeoutData : mMsTimeoutIdle;
+	map<int, EventConnEpoll>::iterator iter;
+	uint32_t diffMs;
+
+	while (mLstConnsIdle.size())
+	{
+		iter = mConnsEpoll.find(mLstConnsIdle.front());
+
+		diffMs = curTimeMs - iter->second.msStart;
+		if (diffMs < msDelayMax)
+			break;
+
+		procErrLog(-1, "data rcv timeout reached. Conn dropped");
+
+		epollConnClose(iter);
+	}
+}
+#endif
+
+/*
+ * Enqueue latency: Time from reading the data
+ * until the event has been stored or delivered.
+ * Collected in a logarithmic histogram to keep
+ * the hot path free of allocations
+ */
+void EventListening::latencyAdd(uint32_t usLatency)
+{
+	size_t idx = 0;
+
+	while (idx < 31 && usLatency >= (1u << idx))
+		++idx;
+
+	++mNumsLatency[idx];
+}
+
+void EventListening::statsUpdate()
+{
+	uint32_t curTimeMs = millis();
+	uint32_t diffMs = curTimeMs - mMsStats;
+	uint32_t numEvents, numEventsSum = 0;
+	size_t idx;
+
+	if (diffMs < 1000)
+		return;
+
+	numEvents = mNumEventsRcvd - mNumEventsStats;
+	mEventsPerSec = (uint64_t)numEvents * 1000 / diffMs;
+
+	// Upper bound of the bucket containing the 99th percentile
+	for (idx = 0; idx < 32; ++idx)
+	{
+		numEventsSum += mNumsLatency[idx];
+		if ((uint64_t)numEventsSum * 100 >= (uint64_t)numEvents * 99)
+			break;
+	}
+
+	if (numEvents)
+		mUsLatencyP99 = idx < 31 ? 1u << idx : UINT32_MAX;
+
+	memset(mNumsLatency, 0, sizeof(mNumsLatency));
+
+	mNumEventsStats = mNumEventsRcvd;
+	mMsStats = curTimeMs;
+}
+
+void EventListening::processInfo(char *pBuf, char *pBufEnd)
+{
+#if 1
+	dInfo("State\t\t\t%s\n", ProcStateString[mState]);
+#endif
+	dInfo("Messages\t\t\t%zu\n", numEventsGet());
+#if defined(__linux__)
+	if (mModeEpoll)
+		dInfo("Connections\t\t%zu\n", mConnsEpoll.size());
+#endif
+	dInfo("Events received\t\t%u\n", mNumEventsRcvd);
+	dInfo("Events dropped\t\t%u\n", mNumEventsDropped);
+	dInfo("Events/s\t\t\t%u\n", mEventsPerSec);
+	dInfo("Enqueue p99\t\t< %u us\n", mUsLatencyP99);
+	dInfo("Store\t\t\t%zu / %zu kB%s\n",
+			(size_t)mSizeStore >> 10, mSizeStoreMax >> 10,
+			mPaused ? " (paused)" : "");
+}
+
+/* static functions */
+
+/*
+ * Events are distributed over independent shards.
+ * Consumers of different references rarely contend for the same lock
+ */
+EventShard &EventListening::shardGet(const string &refMsg)
+{
+	size_t idx = hash<string>()(refMsg) & (dEventNumShards - 1);
+	return mShards[idx];
+}
+
+bool EventListening::entryTake(const string &refMsg, EventEntry &entry)
+{
+	EventShard &shard = shardGet(refMsg);
+	unordered_map<string, deque<EventEntry> >::iterator iter;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(shard.mtx);
+#endif
+	iter = shard.events.find(refMsg);
+	if (iter == shard.events.end())
+		return false;
+
+	EventEntry &entryStored = iter->second.front();
+
+	entry.msg.swap(entryStored.msg);
+	entry.data.swap(entryStored.data);
+	entry.parsed = entryStored.parsed;
+	entry.size = entryStored.size;
+
+	mSizeStore -= entry.size;
+	iter->second.pop_front();
+
+	if (!iter->second.size())
+		shard.events.erase(iter);
+
+	return true;
+}
+
+/*
+ * Delivery stops as soon as the subscriber
+ * unsubscribed from within the callback
+ */
+bool EventListening::subscriptionStart(const string &refMsg, const EventSubscription &sub)
+{
+	EventShard &shard = shardGet(refMsg);
+	EventSubscription *pSub;
+	deque<EventEntry> entries;
+	bool removed;
+
+	pSub = subscriptionAdd(refMsg, sub, entries);
+	if (!pSub)
+		return false;
+
+	if (!entries.size())
+		return true;
+
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		{
+#if CONFIG_PROC_HAVE_DRIVERS
+			Guard lock(shard.mtx);
+#endif
+			removed = pSub->removed;
+		}
+
+		if (removed)
+			break;
+
+		entryDeliver(refMsg, entries[i], pSub);
+	}
+
+	deliveryFinish(refMsg, pSub);
+
+	return true;
+}
+
+/*
+ * Stored events are handed over to the new subscriber.
+ * Their delivery is accounted as callback in progress
+ */
+EventSubscription *EventListening::subscriptionAdd(const string &refMsg,
+					const EventSubscription &sub,
+					deque<EventEntry> &entries)
+{
+	EventShard &shard = shardGet(refMsg);
+	unordered_map<string, deque<EventEntry> >::iterator iter;
+	EventSubscription *pSub;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(shard.mtx);
+#endif
+	if (shard.subs.count(refMsg))
+		return NULL;
+
+	pSub = &shard.subs[refMsg];
+	*pSub = sub;
+
+	iter = shard.events.find(refMsg);
+	if (iter == shard.events.end())
+		return pSub;
+
+	entries.swap(iter->second);
+	shard.events.erase(iter);
+
+	for (size_t i = 0; i < entries.size(); ++i)
+		mSizeStore -= entries[i].size;
+
+	++pSub->numDelivering;
+
+	return pSub;
+}
+
+/*
+ * The subscription can't be erased while callbacks are in progress.
+ * Therefore pSub stays valid until the last one has finished
+ */
+void EventListening::deliveryFinish(const string &refMsg, EventSubscription *pSub)
+{
+	EventShard &shard = shardGet(refMsg);
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(shard.mtx);
+#endif
+	--pSub->numDelivering;
+
+	if (!pSub->numDelivering && pSub->removed)
+		shard.subs.erase(refMsg);
+#if CONFIG_PROC_HAVE_DRIVERS
+	shard.cvDelivered.notify_all();
+#endif
+}
+
+/*
+ * Events which can't be parsed are not delivered to JSON subscribers
+ */
+void EventListening::entryDeliver(const string &refMsg,
+					EventEntry &entry, EventSubscription *pSub)
+{
+	EventSubscription *pSubOuter = mpSubDelivering;
+
+	mpSubDelivering = pSub;
+
+	if (pSub->pFctDataNotify)
+	{
+		string data;
+
+		entryToData(entry, data);
+		pSub->pFctDataNotify(refMsg, data, pSub->pUser);
+	}
+	else if (pSub->pFctNotify)
+	{
+		Value msgEvent;
+
+		if (entryToJson(entry, msgEvent))
+			pSub->pFctNotify(refMsg, msgEvent, pSub->pUser);
+	}
+
+	mpSubDelivering = pSubOuter;
+}
+
+bool EventListening::entryToJson(EventEntry &entry, Value &msgEvent)
+{
+	Reader jReader;
+	bool ok;
+
+	if (entry.parsed)
+	{
+		msgEvent.swap(entry.msg);
+		return true;
+	}
+
+	ok = jReader.parse(entry.data.data(),
+				entry.data.data() + entry.data.size(),
+				msgEvent, false);
+	if (!ok)
+		return false;
+
+	entry.data.clear();
+
+	return true;
+}
+
+void EventListening::entryToData(EventEntry &entry, string &data)
+{
+	if (!entry.parsed)
+	{
+		data.swap(entry.data);
+		return;
+	}
+
+	StreamWriterBuilder jBuilder;
+
+	jBuilder["indentation"] = "";
+	data = writeString(jBuilder, entry.msg);
+}
+
+uint32_t EventListening::usTickGet()
+{
+	auto now = steady_clock::now();
+	auto nowUs = time_point_cast<microseconds>(now);
+	return (uint32_t)nowUs.time_since_epoch().count();
+}
+
+size_t EventListening::numEventsGet()
+{
+	size_t numEvents = 0;
+
+	for (size_t i = 0; i < dEventNumShards; ++i)
+	{
+		EventShard &shard = mShards[i];
+#if CONFIG_PROC_HAVE_DRIVERS
+		Guard lock(shard.mtx);
+#endif
+		unordered_map<string, deque<EventEntry> >::iterator iter;
+
+		iter = shard.events.begin();
+		for (; iter != shard.events.end(); ++iter)
+			numEvents += iter->second.size();
+	}
+
+	return numEvents;
+}
 
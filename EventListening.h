@@ -28,18 +28,103 @@
 
 #include <list>
 #include <map>
+#include <deque>
+#include <unordered_map>
+#include <atomic>
+#if CONFIG_PROC_HAVE_DRIVERS
+#include <condition_variable>
+#endif
 #include <jsoncpp/json/json.h>
 
 #include "Processing.h"
 #include "TcpListening.h"
 #include "TcpTransfering.h"
+#include "RingBuffer.h"
+
+#define dEventNumShards		16 // Must be power of two
+
+enum EventFraming
+{
+	EvFramingNone = 0,	// One message per connection
+	EvFramingNewline,	// Newline delimited messages
+	EvFramingLength,	// Messages prefixed with 32 bit length. Big endian
+	EvFramingBinary,	// Fixed header and raw bytes. No JSON parsing on receive
+};
+
+enum EventPolicy
+{
+	EvPolicyOverwrite = 0,	// Only the latest event is kept
+	EvPolicyQueue,		// Events are queued and popped in order
+};
+
+struct EventPolicyCfg
+{
+	EventPolicy policy;
+	size_t numQueueMax;
+};
 
 struct OpenEventConn
 {
 	TcpTransfering *pConn;
 	uint32_t msStart;
+	RingBuffer buf;
+	size_t offsScan;
 };
 
+typedef void (*FuncEventNotify)(const std::string &refMsg, Json::Value &msgEvent, void *pUser);
+typedef void (*FuncEventDataNotify)(const std::string &refMsg, std::string &data, void *pUser);
+
+struct EventSubscription
+{
+	FuncEventNotify pFctNotify;
+	FuncEventDataNotify pFctDataNotify;
+	void *pUser;
+	int fdNotify;
+	size_t numDelivering; // Callbacks in progress
+	bool removed; // Released when the last callback returned
+};
+
+struct EventEntry
+{
+	Json::Value msg;
+	std::string data; // Raw bytes if not parsed
+	bool parsed;
+	size_t size; // Accounted in store memory
+	uint32_t msEnqueued;
+	uint32_t id;
+};
+
+struct EventExpiry
+{
+	std::string refMsg;
+	uint32_t msEnqueued;
+	uint32_t id;
+};
+
+struct EventShard
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	std::mutex mtx;
+	std::condition_variable cvDelivered;
+#endif
+	std::unordered_map<std::string, std::deque<EventEntry> > events;
+	std::unordered_map<std::string, EventSubscription> subs;
+	std::unordered_map<std::string, EventPolicyCfg> policies;
+	std::deque<EventExpiry> expiries; // Ordered by enqueue time
+	uint32_t idNext;
+};
+
+#if defined(__linux__)
+struct EventConnEpoll
+{
+	int fd;
+	uint32_t msStart;
+	RingBuffer buf;
+	size_t offsScan;
+	std::list<int>::iterator iterIdle;
+};
+#endif
+
 class EventListening : public Processing
 {
 
@@ -50,9 +135,41 @@ public:
 		return new dNoThrow EventListening;
 	}
 
+	void epollModeSet(bool en);
+	void framingSet(EventFraming framing);
+	void portSet(uint16_t port);
+	void numConnsMaxSet(size_t numConnsMax);
+	void msTimeoutDataSet(uint32_t msTimeout);
+	void msTimeoutIdleSet(uint32_t msTimeout);
+	void msTimeoutDequeueSet(uint32_t msTimeout);
+	void sizeMsgMaxSet(size_t sizeMax);
+	void sizeStoreMaxSet(size_t sizeMax);
+	void watermarksSet(size_t sizeHigh, size_t sizeLow);
+
+	static void policySet(
+			const std::string &refMsg,
+			EventPolicy policy,
+			size_t numQueueMax = 0);
+
 	static ssize_t pop(
 			const std::string &refMsg,
 			Json::Value &msgEvent);
+	static ssize_t pop(
+			const std::string &refMsg,
+			std::string &data);
+
+	static bool subscribe(
+			const std::string &refMsg,
+			FuncEventNotify pFctNotify,
+			void *pUser = NULL);
+	static bool subscribe(
+			const std::string &refMsg,
+			FuncEventDataNotify pFctDataNotify,
+			void *pUser = NULL);
+#if defined(__linux__)
+	static int subscribeFd(const std::string &refMsg);
+#endif
+	static void unsubscribe(const std::string &refMsg);
 
 protected:
 
@@ -71,28 +188,87 @@ private:
 
 	/* member functions */
 	Success process();
+	Success shutdown();
 	void processInfo(char *pBuf, char *pBufEnd);
 
+	Success listenerStart();
 	void connectionsAccept();
 	void dataTimeoutsCheck();
 	void dataReceive();
-	Success msgEnqueue(TcpTransfering *pConn);
+	Success msgReceive(OpenEventConn &conn);
+	Success msgSingleParse(RingBuffer &buf, bool eof);
+	Success msgEnqueue(const char *pData, size_t len);
+	Success msgEnqueue(Json::Value &msgEvent, size_t len);
+	Success msgEnqueue(const std::string &refMsg, const char *pData, size_t len);
+	Success eventStore(const std::string &refMsg, EventEntry &entry);
+	Success framesReceive(OpenEventConn &conn);
+	Success framesParse(RingBuffer &buf, size_t &offsScan);
 	void dequeueTimeoutsCheck();
+	Success backpressureUpdate();
+	size_t sizeBufConnMax() const;
+#if defined(__linux__)
+	Success epollStart();
+	void epollEventsProcess();
+	void epollConnsAccept();
+	Success epollDataReceive(EventConnEpoll &conn);
+	void epollConnClose(std::map<int, EventConnEpoll>::iterator iter);
+	void epollDataTimeoutsCheck();
+#endif
+	void statsUpdate();
+	void latencyAdd(uint32_t usLatency);
 
 	/* member variables */
 	//uint32_t mStartMs;
+	uint32_t mStateSd;
 	TcpListening *mpLst;
 	std::list<OpenEventConn> mConnsOpen;
 	char mBuf[512];
-	ssize_t mLenBuf;
+	bool mModeEpoll;
+	EventFraming mFraming;
+	uint16_t mPort;
+	size_t mNumConnsMax;
+	uint32_t mMsTimeoutData;
+	uint32_t mMsTimeoutIdle;
+	uint32_t mMsTimeoutDequeue;
+	size_t mSizeMsgMax;
+	size_t mSizeStoreMax;
+	size_t mSizeHigh;
+	size_t mSizeLow;
+	bool mPaused;
+#if defined(__linux__)
+	int mFdLst;
+	int mFdEpoll;
+	std::map<int, EventConnEpoll> mConnsEpoll;
+	std::list<int> mLstConnsIdle; // Ordered by last activity
+#endif
+	uint32_t mNumEventsRcvd;
+	uint32_t mNumEventsDropped;
+	uint32_t mMsStats;
+	uint32_t mNumEventsStats;
+	uint32_t mEventsPerSec;
+	uint32_t mUsRcvd; // Time of the last read
+	uint32_t mNumsLatency[32]; // Enqueue latency. Bucket n: < 2^n us
+	uint32_t mUsLatencyP99;
 
 	/* static functions */
+	static EventShard &shardGet(const std::string &refMsg);
+	static bool entryTake(const std::string &refMsg, EventEntry &entry);
+	static bool subscriptionStart(const std::string &refMsg, const EventSubscription &sub);
+	static EventSubscription *subscriptionAdd(const std::string &refMsg,
+					const EventSubscription &sub,
+					std::deque<EventEntry> &entries);
+	static void deliveryFinish(const std::string &refMsg, EventSubscription *pSub);
+	static void entryDeliver(const std::string &refMsg,
+					EventEntry &entry, EventSubscription *pSub);
+	static bool entryToJson(EventEntry &entry, Json::Value &msgEvent);
+	static void entryToData(EventEntry &entry, std::string &data);
+	static size_t numEventsGet();
+	static uint32_t usTickGet();
 
 	/* static variables */
-#if CONFIG_PROC_HAVE_DRIVERS
-	static std::mutex mMtxEvents;
-#endif
-	static std::map<std::string, Json::Value> mEvents;
+	static EventShard mShards[dEventNumShards];
+	static std::atomic<size_t> mSizeStore;
+	static thread_local EventSubscription *mpSubDelivering;
 
 	/* constants */
 
@@ -26,17 +26,34 @@
 #include <iostream>
 #include <cstring>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <signal.h>
 #include <sys/wait.h>
 #include <sys/resource.h>
+#include <spawn.h>
+#include <poll.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#endif
 
 #include "FileExecuting.h"
 
+#if defined(__linux__) && defined(SYS_pidfd_open) && defined(SYS_pidfd_send_signal)
+#define dHavePidFd	1
+#else
+#define dHavePidFd	0
+#endif
+
 #define dForEach_ProcState(gen) \
 		gen(StStart) \
 		gen(StInternalStart) \
 		gen(StPipesCreate) \
 		gen(StFork) \
+		gen(StZygoteRspWait) \
 		gen(StParentStart) \
 		gen(StSinksReadyWait) \
 		gen(StChildSupervise) \
@@ -47,6 +64,7 @@
 		gen(StSdContainer) \
 		gen(StSdInternalsFree) \
 		gen(StSdInternals) \
+		gen(StSdZygoteRspWait) \
 		gen(StSdPipesClose) \
 		gen(StSdTmp) \
 
@@ -60,26 +78,76 @@ dProcessStateStr(ProcState);
 
 using namespace std;
 
+int FileExecuting::mFdZygote = -1;
+int FileExecuting::mIdZygote = -1;
+map<int, FeZygoteExit> FileExecuting::mZygoteExits;
+map<uint32_t, FeZygoteMsg> FileExecuting::mZygoteSpawns;
+set<uint32_t> FileExecuting::mZygoteReqsAbandoned;
+set<int> FileExecuting::mZygoteIdsAbandoned;
+uint32_t FileExecuting::mIdZygoteReqNext = 0;
+#if CONFIG_PROC_HAVE_DRIVERS
+mutex FileExecuting::mMtxZygote;
+#endif
+
+const size_t cSizeIoInit = 4096;
+const size_t cSizeIoMaxDefault = 65536;
+const size_t cNumIoBurstMax = 8; // Multiples of the pipe capacity per tick
+const size_t cSizeChunkMin = 4096;
+const size_t cSizeChunkMax = 1024 * 1024;
+const size_t cSizeSinkQueueMax = 4 * 1024 * 1024;
+const uint32_t cMsStateCheck = 200; // Stop/continue, when using pidfds
+const size_t cSizeZygoteMsgMax = 64 * 1024;
+const size_t cNumZygoteFdsMax = 4;
+const uint32_t cMsZygoteRspMax = 1000;
+#if dHavePidFd
+const int cIdTypePidFd = 3; // P_PIDFD
+const int cNumEpollEventsMax = 16;
+#endif
+
 FileExecuting::FileExecuting()
 	: Transfering("FileExecuting")
 	// container & internal
 	, mIsInternal(false)
 	// container
-#if 0 // TODO: Implement
 	, mMsStart(0)
-#endif
 	, mMsTimeout(0)
+	, mMsKillDelay(dMsKillDelayDefault)
+	, mMsSigTerm(0)
+	, mSigTermSent(false)
+	, mSigKillSent(false)
+	, mTimeoutReached(false)
+	, mDirCgroupParent("")
+	, mDirCgroup("")
+	, mSizeMemMax(0)
+	, mCpuPercentMax(0)
+	, mSizePipe(0)
+	, mModeSpawn(FeSpawnFork)
+	, mCaptureOut()
+	, mCaptureErr()
 	, mNodeIn()
 	, mInternalsStarted(false)
 	, mConfigClosed(false)
+	, mFdEpoll(-1)
 	// internal
 	, mCmd("")
 	, mCmdBase("")
 	, mUserEnv(false)
+	, mpArena(NULL)
 	, mpArgs(NULL)
 	, mpEnv(NULL)
 	, mStrStateChild("Running")
 	, mpResult(&mResult)
+	, mFdPid(-1)
+	, mFdCgroupProcs(-1)
+	, mpTimeoutReached(NULL)
+	, mSpawnedByZygote(false)
+	, mIdZygoteReq(0)
+	, mMsZygoteReq(0)
+	, mZygoteReqOpen(false)
+	, mZygoteReqAbandoned(false)
+	, mFdPidWatched(false)
+	, mChildExited(false)
+	, mMsStateCheck(0)
 	, mBytesRead(0)
 	, mBytesSent(0)
 	, mNodeOut()
@@ -137,6 +205,11 @@ Success FileExecuting::process()
 
 		mLstExec.front()->mNodeIn = mNodeIn;
 
+		pipelineLink();
+
+		if (mDirCgroupParent.size() && !cgroupCreate())
+			return procErrLog(-1, "could not create cgroup");
+
 		mResults.reserve(mLstExec.size());
 
 		iter = mLstExec.begin();
@@ -148,6 +221,10 @@ Success FileExecuting::process()
 
 			pExec->mpResult = &mResults.back();
 			pExec->mpResult->idChild = -1;
+			pExec->mSizePipe = mSizePipe;
+			pExec->mModeSpawn = mModeSpawn;
+			pExec->mFdCgroupProcs = mFdCgroupProcs;
+			pExec->mpTimeoutReached = &mTimeoutReached;
 
 			start(pExec);
 		}
@@ -164,11 +241,18 @@ Success FileExecuting::process()
 		break;
 	case StPipesCreate:
 
-		res = pipe(&mNodeIn.pipe.fdRead);
+		nodeDirectSet(&mNodeIn, true);
+		nodeDirectSet(&mNodeOut, false);
+		nodeDirectSet(&mNodeErr, false);
+
+		res = mNodeIn.linked || mNodeIn.direct ? 0 : pipe(&mNodeIn.pipe.fdRead);
 		if (res < 0)
 			return procErrLog(-1, "could not create pipe (stdin): %s", strerror(errno));
 
 		pipeUsed = mNodeOut.manualEnabled || mNodeOut.autoEnabled;
+		if (mNodeOut.linked || mNodeOut.direct)
+			res = 0;
+		else
 		if (pipeUsed)
 			res = pipe(&mNodeOut.pipe.fdRead);
 		else
@@ -180,6 +264,9 @@ Success FileExecuting::process()
 					strerror(errno));
 
 		pipeUsed = mNodeErr.manualEnabled || mNodeErr.autoEnabled;
+		if (mNodeErr.direct)
+			res = 0;
+		else
 		if (pipeUsed)
 			res = pipe(&mNodeErr.pipe.fdRead);
 		else
@@ -190,6 +277,15 @@ Success FileExecuting::process()
 					pipeUsed ? "pipe" : "write fd",
 					strerror(errno));
 
+		if (!mNodeIn.linked && !mNodeIn.direct)
+			pipeSizeApply(mNodeIn.pipe.fdWrite);
+
+		if (mNodeOut.manualEnabled || mNodeOut.autoEnabled)
+			pipeSizeApply(mNodeOut.pipe.fdRead);
+
+		if (mNodeErr.manualEnabled || mNodeErr.autoEnabled)
+			pipeSizeApply(mNodeErr.pipe.fdRead);
+
 		mState = StFork;
 
 		break;
@@ -198,79 +294,86 @@ Success FileExecuting::process()
 		procWrnLog("Forking");
 		procWrnLog("Using file: %s", mCmdBase.c_str());
 #endif
-		mpArgs = vecConstCharToCharList(mArgs);
-		if (!mpArgs)
-			return procErrLog(-1, "could not create arguments");
+		ok = argsArenaCreate();
+		if (!ok)
+			return procErrLog(-1, "could not create arguments and environment");
 
-		mpEnv = vecConstCharToCharList(mEnv);
-		if (!mpEnv)
+		if (mModeSpawn == FeSpawnZygote)
 		{
-			ptrListFree(mArgs.size(), mpArgs);
-			return procErrLog(-1, "could not create environment");
+			success = zygoteSpawn();
+			argsArenaFree();
+
+			if (success == Pending)
+				break; // Zygote not running. Retry using vfork()
+
+			if (success != Positive)
+				return success;
+
+			mState = StZygoteRspWait;
+			break;
 		}
 
-		idProc = vfork();
-		if (idProc)
+		// Limits must be applied in the child
+		if (mModeSpawn == FeSpawnPosix && !mRlimits.size() && mFdCgroupProcs < 0)
 		{
-			ptrListFree(mArgs.size(), mpArgs);
-			ptrListFree(mEnv.size(), mpEnv);
+			success = childSpawn();
+			argsArenaFree();
+
+			if (success == Pending)
+				break; // Not supported. Retry using vfork()
+
+			if (success != Positive)
+				return success;
+
+			if (!mpResult->childTerminated)
+				pidFdOpen();
+
+			mState = StParentStart;
+			break;
 		}
 
+		idProc = vfork();
+		if (idProc)
+			argsArenaFree();
+
 		if (idProc < 0)
 			return procErrLog(-1, "could not fork process: %s", strerror(errno));
 
 		if (idProc > 0)
 		{
 			mpResult->idChild = idProc;
+			pidFdOpen();
+
 			mState = StParentStart;
 			break;
 		}
 
 		// Child
+		childExec(mNodeIn.pipe.fdRead, mNodeOut.pipe.fdWrite, mNodeErr.pipe.fdWrite,
+				mFdCgroupProcs, mRlimits, mpArgs, mUserEnv ? mpEnv : environ);
 
-		// Setup Pipes
-#if 1
-		res = dup2(mNodeErr.pipe.fdWrite, STDERR_FILENO);
-		if (res < 0)
-			_exit(EXIT_FAILURE); // only valid situation in every system to use _exit()!
-#endif
-		res = dup2(mNodeIn.pipe.fdRead, STDIN_FILENO);
-		if (res < 0)
-		{
-			cerr << "could not duplicate fd (stdin): " << strerror(errno) << endl;
-			_exit(EXIT_FAILURE);
-		}
+		break;
+	case StZygoteRspWait:
 
-		res = dup2(mNodeOut.pipe.fdWrite, STDOUT_FILENO);
-		if (res < 0)
-		{
-			cerr << "could not duplicate fd (stdout): " << strerror(errno) << endl;
-			_exit(EXIT_FAILURE);
-		}
+		success = zygoteRspGet();
+		if (success == Pending)
+			break;
 
-		// Close all open files
-		ok = closefromInternal(3);
-		if (!ok)
-		{
-			cerr << "could close file descriptors: " << strerror(errno) << endl;
-			_exit(EXIT_FAILURE);
-		}
+		if (success != Positive)
+			return success;
 
-		// Execute
-		res = execvpe(mpArgs[0], mpArgs, mUserEnv ? mpEnv : environ);
-		if (res < 0)
-		{
-			cerr << "could not execute file '" << mpArgs[0] << "': " << strerror(errno) << endl;
-			_exit(EXIT_FAILURE);
-		}
+		pidFdOpen();
 
-		cerr << "reached invalid position" << endl;
-		_exit(EXIT_FAILURE);
+		mState = StParentStart;
 
 		break;
 	case StParentStart:
 
 		//procWrnLog("ID child: %d", mpResult->idChild);
+		mpResult->msStart = millis();
+
+		if (mpResult->childTerminated)
+			mpResult->msEnd = mpResult->msStart; // Spawn failed
 
 		/* IMPORTANT:
 		 * Do not close read end of stdin pipe in parent
@@ -280,6 +383,10 @@ Success FileExecuting::process()
 		 */
 		//fdClose(mNodeIn.pipe.fdRead);
 
+		// Linked pipes and files are never written by the parent
+		if (mNodeIn.linked || mNodeIn.direct)
+			fdClose(mNodeIn.pipe.fdRead);
+
 		fdClose(mNodeOut.pipe.fdWrite);
 		fdClose(mNodeErr.pipe.fdWrite);
 
@@ -299,6 +406,14 @@ Success FileExecuting::process()
 		if (!ok)
 			return procErrLog(-3, "could not set non blocking mode: %s", strerror(errno));
 
+		mNodeIn.sizeIoMax = pipeSizeGet(mNodeIn.pipe.fdWrite);
+		mNodeOut.sizeIoMax = pipeSizeGet(mNodeOut.pipe.fdRead);
+		mNodeErr.sizeIoMax = pipeSizeGet(mNodeErr.pipe.fdRead);
+
+		nodeKernelIoCheck(&mNodeIn, true);
+		nodeKernelIoCheck(&mNodeOut, false);
+		nodeKernelIoCheck(&mNodeErr, false);
+
 		{
 #if CONFIG_PROC_HAVE_DRIVERS
 			Guard lock(mMtxWrite);
@@ -338,9 +453,12 @@ Success FileExecuting::process()
 		autoSink(&mNodeOut);
 		autoSink(&mNodeErr);
 
-		success = childStateRecord();
-		if (success != Pending && success != Positive)
-			return procErrLog(-1, "chould not record child state");
+		if (childStateCheckDue())
+		{
+			success = childStateRecord();
+			if (success != Pending && success != Positive)
+				return procErrLog(-1, "chould not record child state");
+		}
 
 		if (!mpResult->childTerminated)
 			return Pending;
@@ -350,12 +468,24 @@ Success FileExecuting::process()
 
 		if (mNodeErr.pipe.fdRead != -1)
 			return Pending;
+
+		if (mNodeOut.eof || mNodeErr.eof)
+			return Pending;
+
+		if (mpResult->bytesDropped)
+			return procErrLog(-1, "sinks did not accept all data");
 #if 1
 		return Positive;
 #endif
 		break;
 	case StContainerStart:
 
+		mMsStart = millis();
+#if dHavePidFd
+		mFdEpoll = epoll_create1(EPOLL_CLOEXEC);
+		if (mFdEpoll < 0)
+			procWrnLog("could not create epoll. Polling children: %s", strerror(errno));
+#endif
 		mState = StInternalsSupervise;
 
 		break;
@@ -370,7 +500,8 @@ Success FileExecuting::process()
 		if (mDone)
 			mLstExec.front()->doneSet();
 
-		// TODO: Timeout
+		childrenExitCheck();
+		timeoutCheck();
 
 		return childrenSuccess();
 
@@ -385,6 +516,184 @@ Success FileExecuting::process()
 	return Pending;
 }
 
+/*
+ * Adjacent commands are connected by a single pipe
+ * if the output of a command has no other sink.
+ * Data then flows from child to child inside the kernel.
+ * Otherwise the parent relays the data using autoSink()
+ */
+void FileExecuting::pipelineLink()
+{
+	FileExecuting *pPrev, *pNext;
+	FeNode *pOut, *pIn;
+	int res;
+
+	for (size_t i = 1; i < mLstExec.size(); ++i)
+	{
+		pPrev = mLstExec[i - 1];
+		pNext = mLstExec[i];
+
+		pOut = &pPrev->mNodeOut;
+		pIn = &pNext->mNodeIn;
+
+		if (pOut->manualEnabled)
+			continue;
+
+		if (nodeHasSinksExtra(pOut) || pOut->lstFds.size())
+			continue;
+
+		if (pOut->lstTransfers.size() != 1 || pOut->lstTransfers.front() != pNext)
+			continue;
+
+		if (pIn->autoEnabled)
+			continue;
+
+		res = pipe(&pIn->pipe.fdRead);
+		if (res < 0)
+		{
+			procWrnLog("could not create pipe for link: %s", strerror(errno));
+			continue;
+		}
+
+		pipeSizeApply(pIn->pipe.fdWrite);
+
+		pOut->pipe.fdWrite = pIn->pipe.fdWrite;
+		pIn->pipe.fdWrite = -1;
+
+		pOut->lstTransfers.clear();
+		pOut->autoEnabled = false;
+		pOut->linked = true;
+
+		pIn->manualEnabled = false;
+		pIn->linked = true;
+	}
+}
+
+/*
+ * On timeout the running children are asked to terminate.
+ * Children ignoring SIGTERM are killed after the kill delay
+ */
+void FileExecuting::timeoutCheck()
+{
+	uint32_t curTimeMs;
+
+	if (!mMsTimeout || mSigKillSent)
+		return;
+
+	curTimeMs = millis();
+
+	if (!mSigTermSent)
+	{
+		if (curTimeMs - mMsStart < mMsTimeout)
+			return;
+
+		procWrnLog("execution timeout reached. Terminating children");
+
+		sigSendRunning(SIGTERM);
+
+		mMsSigTerm = curTimeMs;
+		mSigTermSent = true;
+		mTimeoutReached = true;
+
+		return;
+	}
+
+	if (curTimeMs - mMsSigTerm < mMsKillDelay)
+		return;
+
+	if (childTerminated(-1, true))
+		return;
+
+	procWrnLog("children still running. Killing children");
+
+	sigSendRunning(SIGKILL);
+	mSigKillSent = true;
+}
+
+void FileExecuting::sigSendRunning(int sig)
+{
+	for (size_t i = 0; i < mResults.size(); ++i)
+	{
+		if (mResults[i].childTerminated || mResults[i].idChild < 0)
+			continue;
+
+		sigSend(sig, i);
+	}
+}
+
+/*
+ * Literature
+ * - https://docs.kernel.org/admin-guide/cgroup-v2.html
+ */
+bool FileExecuting::cgroupCreate()
+{
+	char buf[64];
+	int res;
+
+	snprintf(buf, sizeof(buf), "/fe-%d-%lx", (int)getpid(), (unsigned long)(uintptr_t)this);
+
+	mDirCgroup = mDirCgroupParent + buf;
+
+	res = mkdir(mDirCgroup.c_str(), 0755);
+	if (res < 0)
+	{
+		procErrLog(-1, "could not create directory %s: %s",
+				mDirCgroup.c_str(), strerror(errno));
+		mDirCgroup = "";
+		return false;
+	}
+
+	if (mSizeMemMax && !fileWrite(mDirCgroup + "/memory.max", to_string(mSizeMemMax)))
+		procWrnLog("could not set memory limit. Controller enabled?");
+
+	// Quota per period of 100ms
+	if (mCpuPercentMax && !fileWrite(mDirCgroup + "/cpu.max",
+					to_string(mCpuPercentMax * 1000) + " 100000"))
+		procWrnLog("could not set CPU limit. Controller enabled?");
+
+	mFdCgroupProcs = open((mDirCgroup + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+	if (mFdCgroupProcs < 0)
+	{
+		procErrLog(-1, "could not open cgroup.procs: %s", strerror(errno));
+		cgroupRemove();
+		return false;
+	}
+
+	return true;
+}
+
+void FileExecuting::cgroupRemove()
+{
+	int res;
+
+	fdClose(mFdCgroupProcs);
+
+	if (!mDirCgroup.size())
+		return;
+
+	res = rmdir(mDirCgroup.c_str());
+	if (res < 0)
+		procWrnLog("could not remove cgroup %s: %s",
+				mDirCgroup.c_str(), strerror(errno));
+
+	mDirCgroup = "";
+}
+
+bool FileExecuting::fileWrite(const string &path, const string &str)
+{
+	ssize_t res;
+	int fd;
+
+	fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	res = write(fd, str.c_str(), str.size());
+	close(fd);
+
+	return res == (ssize_t)str.size();
+}
+
 bool FileExecuting::sinksReady(FeNode *pNode) const
 {
 	list<Transfering *>::iterator iTrans;
@@ -402,93 +711,274 @@ bool FileExecuting::sinksReady(FeNode *pNode) const
 	return true;
 }
 
-Success FileExecuting::childStateRecord()
+/*
+ * The pidfds of all internals are kept in one epoll set.
+ * A pidfd becomes readable when the child terminates.
+ * Running children therefore cost nothing.
+ * Internals without a watched pidfd poll on every tick
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man2/pidfd_open.2.html
+ * - https://man7.org/linux/man-pages/man2/epoll_wait.2.html
+ */
+void FileExecuting::childrenExitCheck()
 {
-	if (mpResult->childTerminated)
-		return Pending;
+#if dHavePidFd
+	if (mFdEpoll < 0)
+		return;
 
-	pid_t idProc;
-	int res;
+	struct epoll_event evs[cNumEpollEventsMax];
+	struct epoll_event ev;
+	vector<FileExecuting *>::iterator iter;
+	FileExecuting *pExec;
+	int numEvents, res;
 
-	idProc = waitpid(mpResult->idChild, &res, WNOHANG | WUNTRACED | WCONTINUED);
+	iter = mLstExec.begin();
+	for (; iter != mLstExec.end(); ++iter)
+	{
+		pExec = *iter;
 
-	if (idProc < 0 && errno != EAGAIN)
-		return procErrLog(-1, "could not wait for child: %s", strerror(errno));
+		if (pExec->mFdPid < 0 || pExec->mFdPidWatched)
+			continue;
 
-	if (!idProc || (idProc < 0 && errno == EAGAIN))
+		memset(&ev, 0, sizeof(ev));
+
+		ev.events = EPOLLIN;
+		ev.data.ptr = pExec;
+
+		res = epoll_ctl(mFdEpoll, EPOLL_CTL_ADD, pExec->mFdPid, &ev);
+		if (res < 0)
+		{
+			procWrnLog("could not watch pidfd: %s", strerror(errno));
+			continue;
+		}
+
+		pExec->mFdPidWatched = true;
+	}
+
+	numEvents = epoll_wait(mFdEpoll, evs, cNumEpollEventsMax, 0);
+
+	for (int i = 0; i < numEvents; ++i)
+	{
+		pExec = (FileExecuting *)evs[i].data.ptr;
+
+		epoll_ctl(mFdEpoll, EPOLL_CTL_DEL, pExec->mFdPid, NULL);
+		pExec->mChildExited = true;
+	}
+#endif
+}
+
+void FileExecuting::pidFdOpen()
+{
+#if dHavePidFd
+	mFdPid = syscall(SYS_pidfd_open, mpResult->idChild, 0);
+	if (mFdPid < 0)
+		procDbgLog("could not open pidfd. Polling child: %s", strerror(errno));
+#endif
+}
+
+/*
+ * With a watched pidfd, the termination is signaled by the container.
+ * Changes of the stop state don't wake up a pidfd.
+ * They are checked at a low rate instead
+ */
+bool FileExecuting::childStateCheckDue()
+{
+	uint32_t curTimeMs;
+
+	if (mFdPid < 0 || !mFdPidWatched || mChildExited)
+		return true;
+
+	curTimeMs = millis();
+
+	if (curTimeMs - mMsStateCheck < cMsStateCheck)
+		return false;
+
+	mMsStateCheck = curTimeMs;
+
+	return true;
+}
+
+Success FileExecuting::childStateRecord()
+{
+	if (mpResult->childTerminated)
 		return Pending;
 
+	Success success;
+	int code, status;
+
+	success = childStateGet(code, status);
+	if (success != Positive)
+		return success;
+
 	//procWrnLog("state of child changed");
 
-	if (WIFEXITED(res))
+	if (code == CLD_EXITED)
 	{
 		mStrStateChild = "Terminated by exit()";
 
 		mpResult->idChild = -1;
 		mpResult->childTerminated = true;
 		mpResult->childTerminatedBySig = false;
-		mpResult->codeRet = WEXITSTATUS(res);
+		mpResult->codeRet = status;
 	}
 	else
-	if (WIFSIGNALED(res))
+	if (code == CLD_KILLED || code == CLD_DUMPED)
 	{
 		mStrStateChild = "Terminated by signal";
 
 		mpResult->idChild = -1;
 		mpResult->childTerminated = true;
 		mpResult->childTerminatedBySig = true;
-		mpResult->codeSig = WTERMSIG(res);
-#if 0
-		mpResult->coreDumped = (bool)WCOREDUMP(res);
-#endif
+		mpResult->codeSig = status;
+		mpResult->coreDumped = code == CLD_DUMPED;
 	}
 	else
-	if (WIFSTOPPED(res))
+	if (code == CLD_STOPPED || code == CLD_TRAPPED)
 	{
 		mStrStateChild = "Stopped";
 		mpResult->childStopped = true;
-		mpResult->codeSig = WSTOPSIG(res);
+		mpResult->codeSig = status;
 	}
 	else
-	if (WIFCONTINUED(res))
+	if (code == CLD_CONTINUED)
 	{
 		mStrStateChild = "Running (Continued)";
 		mpResult->childStopped = false;
 		mpResult->codeSig = 0;
 	}
 	else
-		return procErrLog(-1, "unknown child state recorded: %d", res);
+		return procErrLog(-1, "unknown child state recorded: %d", code);
+
+	if (mpResult->childTerminated)
+	{
+		mpResult->msEnd = millis();
+		fdClose(mFdPid);
+	}
 
 	return Positive;
 }
 
-void FileExecuting::autoSource(FeNode *pNode)
+void FileExecuting::bytesCount(const FeNode *pNode, size_t len)
 {
-	if (!pNode || !pNode->autoEnabled)
-		return;
-
-	if (pNode->autoDone)
-		return;
+	if (pNode == &mNodeIn)
+		mpResult->bytesIn += len;
+	else
+	if (pNode == &mNodeOut)
+		mpResult->bytesOut += len;
+	else
+		mpResult->bytesErr += len;
+}
 
-	ssize_t lenReq = 512;
-	ssize_t lenLeft, lenPlanned, lenDone;
-	const char *pSrc;
-	bool isErr, wouldBlock, isErrFinal, isDone;
+/*
+ * Returns the state change of the child
+ * in terms of siginfo_t: CLD_EXITED, CLD_KILLED, ...
+ * Using the pidfd rules out races with reused PIDs
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man2/waitid.2.html
+ */
+Success FileExecuting::childStateGet(int &code, int &status)
+{
+	pid_t idProc;
+	int res;
 
-	if (pNode->lstBuffers.size())
+	if (mSpawnedByZygote)
+		return zygoteStateGet(code, status);
+#if dHavePidFd
+	if (mFdPid >= 0)
 	{
-		FeNodeBuffer *pBuff = &pNode->lstBuffers.front();
+		siginfo_t info;
 
-		pSrc = pBuff->pSrc + pBuff->processed;
+		memset(&info, 0, sizeof(info));
 
-		lenLeft = pBuff->len - pBuff->processed;
-		lenPlanned = PMIN(lenReq, lenLeft);
-		lenDone = intSend(pSrc, lenPlanned);
+		// Unlike waitid(), the system call also reports the resource usage
+		res = syscall(SYS_waitid, cIdTypePidFd, mFdPid, &info,
+				WEXITED | WSTOPPED | WCONTINUED | WNOHANG, &mpResult->usage);
 
-		if (lenDone < 0)
-		{
-			autoSourceDone();
-			return;
+		if (res < 0 && (errno == EAGAIN || errno == EINTR))
+			return Pending;
+
+		if (res < 0)
+			return procErrLog(-1, "could not wait for child: %s", strerror(errno));
+
+		if (!info.si_pid)
+			return Pending;
+
+		code = info.si_code;
+		status = info.si_status;
+
+		return Positive;
+	}
+#endif
+	idProc = wait4(mpResult->idChild, &res, WNOHANG | WUNTRACED | WCONTINUED, &mpResult->usage);
+
+	if (idProc < 0 && errno != EAGAIN)
+		return procErrLog(-1, "could not wait for child: %s", strerror(errno));
+
+	if (!idProc || (idProc < 0 && errno == EAGAIN))
+		return Pending;
+
+	if (WIFEXITED(res))
+	{
+		code = CLD_EXITED;
+		status = WEXITSTATUS(res);
+	}
+	else
+	if (WIFSIGNALED(res))
+	{
+		code = WCOREDUMP(res) ? CLD_DUMPED : CLD_KILLED;
+		status = WTERMSIG(res);
+	}
+	else
+	if (WIFSTOPPED(res))
+	{
+		code = CLD_STOPPED;
+		status = WSTOPSIG(res);
+	}
+	else
+	if (WIFCONTINUED(res))
+	{
+		code = CLD_CONTINUED;
+		status = 0;
+	}
+	else
+		return procErrLog(-1, "unknown child state recorded: %d", res);
+
+	return Positive;
+}
+
+/*
+ * Writes to the stdin pipe until it is full.
+ * Data which didn't fit is kept in the node buffer
+ * and sent first on the next tick
+ */
+void FileExecuting::autoSource(FeNode *pNode)
+{
+	if (!pNode || !pNode->autoEnabled)
+		return;
+
+	if (pNode->autoDone)
+		return;
+
+	size_t lenTickMax = cNumIoBurstMax * pNode->sizeIoMax;
+	size_t lenTick = 0;
+	ssize_t lenLeft, lenDone;
+	const char *pSrc;
+
+	if (pNode->lstBuffers.size())
+	{
+		FeNodeBuffer *pBuff = &pNode->lstBuffers.front();
+
+		pSrc = pBuff->pSrc + pBuff->processed;
+
+		lenLeft = pBuff->len - pBuff->processed;
+		lenDone = intSend(pSrc, lenLeft);
+
+		if (lenDone < 0)
+		{
+			autoSourceDone();
+			return;
 		}
 
 		pBuff->processed += lenDone;
@@ -501,101 +991,108 @@ void FileExecuting::autoSource(FeNode *pNode)
 		autoSourceDone();
 		return;
 	}
-	else
-	if (pNode->lstFds.size())
-	{
-		FeFileDescSetting *pFd = &pNode->lstFds.front();
-		char buf[15];
-		lenLeft = lenReq;
 
-		while (lenLeft)
-		{
-			lenReq = sizeof(buf) - 1;
-			lenPlanned = PMIN(lenReq, lenLeft);
-			lenDone = ::read(pFd->fd, buf, lenPlanned);
+	if (pNode->kernelIo && !pNode->lenIoPending)
+	{
+		autoSourceKernel(pNode);
 
-			isErr = lenDone < 0;
-			wouldBlock = isErr && ((errno == EAGAIN) || (errno == EWOULDBLOCK));
-			isErrFinal = isErr && !wouldBlock;
-			isDone = !lenDone || wouldBlock || isErrFinal;
+		if (pNode->kernelIo || pNode->autoDone)
+			return;
+	}
 
-			if (isDone)
-			{
-				if (pFd->autoClose)
-					fdClose(pFd->fd);
+	bufIoPrepare(pNode);
 
-				autoSourceDone();
-			}
+	while (lenTick < lenTickMax)
+	{
+		if (pNode->lenIoPending)
+		{
+			pSrc = pNode->bufIo.data() + pNode->offsIoPending;
 
-			if (isErrFinal)
+			lenDone = intSend(pSrc, pNode->lenIoPending);
+			if (lenDone < 0)
 			{
-				procErrLog(-1, "read() failed: %s", strerror(errno));
+				procErrLog(-1, "internal send() failed");
+				autoSourceDone();
 				return;
 			}
 
-			if (isDone)
-			{
-				procDbgLog("end-of-file");
-				return;
-			}
+			pNode->offsIoPending += lenDone;
+			pNode->lenIoPending -= lenDone;
 
-			buf[lenDone] = 0;
+			lenTick += lenDone;
 
-			lenReq = lenDone;
-			lenDone = intSend(buf, lenReq);
+			if (pNode->lenIoPending)
+				return; // Pipe full
+		}
 
-			if (lenDone != lenReq)
-			{
-				procErrLog(-1, "internal send() failed");
-				autoSourceDone();
-				return;
-			}
+		lenDone = autoSourceRead(pNode, pNode->bufIo.data(), pNode->bufIo.size());
+		if (!lenDone)
+			return;
 
-			lenLeft -= lenReq;
+		if (lenDone < 0)
+		{
+			autoSourceDone();
+			return;
 		}
 
-		return;
+		pNode->offsIoPending = 0;
+		pNode->lenIoPending = lenDone;
+
+		bufIoAdapt(pNode, lenDone);
 	}
-	else
-	if (pNode->lstTransfers.size())
+}
+
+/*
+ * Returns
+ * - > 0: Number of bytes read
+ * - = 0: No data available at the moment
+ * - < 0: Source finished
+ */
+ssize_t FileExecuting::autoSourceRead(FeNode *pNode, char *pBuf, size_t lenReq)
+{
+	ssize_t lenDone;
+	bool isErr, wouldBlock, isErrFinal;
+
+	if (pNode->lstFds.size())
 	{
-		Transfering *pTrans = pNode->lstTransfers.front();
-		char buf[15];
-		lenLeft = lenReq;
+		FeFileDescSetting *pFd = &pNode->lstFds.front();
 
-		while (lenLeft)
-		{
-			lenReq = sizeof(buf) - 1;
-			lenPlanned = PMIN(lenReq, lenLeft);
-			lenDone = pTrans->read(buf, lenPlanned);
+		lenDone = ::read(pFd->fd, pBuf, lenReq);
 
-			if (!lenDone)
-				return;
+		isErr = lenDone < 0;
+		wouldBlock = isErr && ((errno == EAGAIN) || (errno == EWOULDBLOCK));
+		isErrFinal = isErr && !wouldBlock;
 
-			if (lenDone < 0)
-			{
-				procDbgLog("end-of-Transfering()");
-				autoSourceDone();
-				return;
-			}
+		if (lenDone > 0)
+			return lenDone;
 
-			buf[lenDone] = 0;
+		if (wouldBlock)
+			return 0;
 
-			lenReq = lenDone;
-			lenDone = intSend(buf, lenReq);
+		if (isErrFinal)
+			procErrLog(-1, "read() failed: %s", strerror(errno));
+		else
+			procDbgLog("end-of-file");
 
-			if (lenDone != lenReq)
-			{
-				procErrLog(-1, "internal send() failed");
-				autoSourceDone();
-				return;
-			}
+		if (pFd->autoClose)
+			fdClose(pFd->fd);
 
-			lenLeft -= lenReq;
-		}
+		return -1;
+	}
 
-		return;
+	if (pNode->lstTransfers.size())
+	{
+		Transfering *pTrans = pNode->lstTransfers.front();
+
+		lenDone = pTrans->read(pBuf, lenReq);
+		if (lenDone >= 0)
+			return lenDone;
+
+		procDbgLog("end-of-Transfering()");
+		return -1;
 	}
+
+	return -1;
 }
 
 void FileExecuting::autoSourceDone()
@@ -613,6 +1110,13 @@ void FileExecuting::autoSourceDone()
 	procDbgLog("autoSourceDone()");
 }
 
+/*
+ * Drains the pipe until it is empty or the
+ * maximum amount of data per tick has been processed.
+ * After end-of-file, the queued data is flushed until
+ * every sink has accepted it or failed. Only the timeout
+ * of the container drops the remaining data
+ */
 void FileExecuting::autoSink(FeNode *pNode)
 {
 	if (!pNode || !pNode->autoEnabled)
@@ -621,56 +1125,85 @@ void FileExecuting::autoSink(FeNode *pNode)
 	if (pNode->autoDone)
 		return;
 
-	char buf[23];
-	size_t numBurst = 23;
+	size_t lenTickMax = cNumIoBurstMax * pNode->sizeIoMax;
+	size_t lenTick = 0;
+	const char *pBuf;
 
 	// buffer
 	list<FeNodeBuffer>::iterator iBuff;
 	FeNodeBuffer *pBuff;
-	ssize_t lenReq;
 	ssize_t lenLeft, lenPlanned, lenDone;
 	char *pDest;
 	// string
 	list<std::string *>::iterator iStr;
-	// fd
-	list<FeFileDescSetting>::iterator iFd;
-	// Transfering
-	list<Transfering *>::iterator iTrans;
+	// fd and Transfering
+	size_t lenReq, lenQueued;
+
+	if (pNode->kernelIo)
+	{
+		autoSinkKernel(pNode);
+
+		if (pNode->kernelIo || pNode->autoDone)
+			return;
+	}
+
+	if (!pNode->queuesCreated)
+		sinkQueuesCreate(pNode);
+
+	sinkQueuesFlush(pNode);
+
+	if (pNode->eof)
+	{
+		if (sinkQueuesEmpty(pNode))
+		{
+			autoSinkDone(pNode);
+			return;
+		}
+
+		if (!mpTimeoutReached || !*mpTimeoutReached)
+			return;
+
+		lenQueued = sinkQueuesLen(pNode);
+
+		procWrnLog("timeout reached. Dropping %zu bytes not accepted by sinks", lenQueued);
+		mpResult->bytesDropped += lenQueued;
+
+		autoSinkDone(pNode);
+		return;
+	}
 
-	buf[0] = 0;
+	bufIoPrepare(pNode);
 
-	while (numBurst--)
+	while (lenTick < lenTickMax)
 	{
-		lenReq = sizeof(buf) - 1;
-		lenPlanned = lenReq;
-		lenDone = intSinkRead(buf, lenPlanned, pNode);
+		// Backpressure. The OS process blocks when its pipe is full
+		if (sinkQueuesFull(pNode))
+			return;
+
+		pBuf = pNode->bufIo.data();
+
+		lenReq = sinkQueuesTee(pNode, pNode->bufIo.size());
+		if (!lenReq)
+			lenReq = pNode->bufIo.size();
+
+		lenDone = intSinkRead(pNode->bufIo.data(), lenReq, pNode);
 
 		if (!lenDone)
 			return;
 
 		if (lenDone < 0)
 		{
-			procDbgLog("autoSink() finished");
-
-			iFd = pNode->lstFds.begin();
-			for (; iFd != pNode->lstFds.end(); ++iFd)
+			if (sinkQueuesEmpty(pNode))
 			{
-				if (!iFd->autoClose)
-					continue;
-
-				procDbgLog("closing auto fd: %d", iFd->fd);
-				fdClose(iFd->fd);
+				autoSinkDone(pNode);
+				return;
 			}
 
-			iTrans = pNode->lstTransfers.begin();
-			for (; iTrans != pNode->lstTransfers.end(); ++iTrans)
-				(*iTrans)->doneSet();
-
-			pNode->autoDone = true;
+			pNode->eof = true;
 			return;
 		}
 
-		buf[lenDone] = 0;
+		lenTick += lenDone;
 
 		// buffer
 		iBuff = pNode->lstBuffers.begin();
@@ -685,16 +1218,15 @@ void FileExecuting::autoSink(FeNode *pNode)
 			if (!lenLeft)
 				continue;
 
-			lenReq = lenDone;
 			lenPlanned = PMIN(lenDone, lenLeft);
 
 			pDest = pBuff->pDest + pBuff->processed;
-			memcpy(pDest, buf, lenPlanned);
+			memcpy(pDest, pBuf, lenPlanned);
 
 			pBuff->processed += lenPlanned;
 
 			if (pBuff->processed < pBuff->len)
-				return;
+				continue;
 
 			procDbgLog("end-of-buffer");
 		}
@@ -702,834 +1234,2734 @@ void FileExecuting::autoSink(FeNode *pNode)
 		// string
 		iStr = pNode->lstStrings.begin();
 		for (; iStr != pNode->lstStrings.end(); ++iStr)
-			*(*iStr) += string(buf, lenDone);
+			(*iStr)->append(pBuf, lenDone);
+
+		// capture
+		if (pNode->pCapture)
+			captureAppend(pNode->pCapture, pBuf, lenDone);
 
-		// fd
-		iFd = pNode->lstFds.begin();
-		for (; iFd != pNode->lstFds.end(); ++iFd)
-			::write(iFd->fd, buf, lenDone);
+		// fd and Transfering
+		sinkQueuesDeliver(pNode, pBuf, lenDone);
 
-		// Transfering
-		iTrans = pNode->lstTransfers.begin();
-		for (; iTrans != pNode->lstTransfers.end(); ++iTrans)
-			(*iTrans)->send(buf, lenDone);
+		bufIoAdapt(pNode, lenDone);
 	}
 }
 
-char **FileExecuting::vecConstCharToCharList(const VecConstChar &lst)
+void FileExecuting::autoSinkDone(FeNode *pNode)
 {
-	size_t cnt = lst.size(); // +1 = NULL
-	char **pElem;
+	list<FeFileDescSetting>::iterator iFd;
+	list<Transfering *>::iterator iTrans;
 
-	pElem = (char **)calloc(cnt + 1, sizeof(char *));
-	if (!pElem)
-	{
-		cerr << "could not allocate memory for list" << endl;
-		return NULL;
-	}
+	procDbgLog("autoSink() finished");
 
-	for (size_t i = 0; i < cnt; ++i)
+	iFd = pNode->lstFds.begin();
+	for (; iFd != pNode->lstFds.end(); ++iFd)
 	{
-		pElem[i] = strdup(lst[i]);
+		if (!iFd->autoClose)
+			continue;
 
-		if (!pElem[i])
-		{
-			cerr << "could not allocate memory for list element" << endl;
-			ptrListFree(lst.size(), pElem);
-			return NULL;
-		}
+		procDbgLog("closing auto fd: %d", iFd->fd);
+		fdClose(iFd->fd);
 	}
 
-	return pElem;
+	iTrans = pNode->lstTransfers.begin();
+	for (; iTrans != pNode->lstTransfers.end(); ++iTrans)
+		(*iTrans)->doneSet();
+
+	pNode->lstQueues.clear();
+	pNode->eof = false;
+	pNode->autoDone = true;
 }
 
-void FileExecuting::ptrListFree(int cnt, char ** &lst)
+/*
+ * Moves data from the source descriptor to the stdin pipe
+ * without copying it to user space.
+ * Falls back to read() and write() if the descriptor doesn't support splice()
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man2/splice.2.html
+ */
+void FileExecuting::autoSourceKernel(FeNode *pNode)
 {
-	if (!lst)
+#if defined(__linux__)
+	FeFileDescSetting *pFd = &pNode->lstFds.front();
+	size_t lenTickMax = cNumIoBurstMax * pNode->sizeIoMax;
+	size_t lenTick = 0;
+	ssize_t lenDone;
+
+	if (!mSendReady || mNodeIn.pipe.fdWrite < 0)
 		return;
 
-	for (int i = 0; i < cnt; ++i)
+	while (lenTick < lenTickMax)
 	{
-		if (!lst[i])
+		lenDone = splice(pFd->fd, NULL, mNodeIn.pipe.fdWrite, NULL,
+				pNode->sizeIoMax, SPLICE_F_NONBLOCK | SPLICE_F_MOVE);
+
+		if (lenDone > 0)
+		{
+			lenTick += lenDone;
+			mBytesSent += lenDone;
+			bytesCount(&mNodeIn, lenDone);
 			continue;
+		}
 
-		free(lst[i]);
-		lst[i] = NULL;
-	}
+		if (lenDone < 0 && (errno == EAGAIN || errno == EINTR))
+			return;
+
+		if (lenDone < 0 && errno == EINVAL)
+		{
+			procDbgLog("splice() not supported by source. Using read()");
+			pNode->kernelIo = false;
+			return;
+		}
+
+		if (lenDone < 0)
+			procErrLog(-1, "splice() failed: %s", strerror(errno));
+		else
+			procDbgLog("end-of-file");
+
+		if (pFd->autoClose)
+			fdClose(pFd->fd);
 
-	free(lst);
-	lst = NULL;
+		autoSourceDone();
+		return;
+	}
+#else
+	pNode->kernelIo = false;
+#endif
 }
 
-Success FileExecuting::shutdown()
+void FileExecuting::autoSinkKernel(FeNode *pNode)
 {
-	//uint32_t curTimeMs = millis();
-	//uint32_t diffMs = curTimeMs - mMsStart;
-	//Success success;
-	//int res;
-	vector<FileExecuting *>::iterator iter;
-#if 0
-	procWrnLog("mState = %s", ProcStateString[mState]);
-#endif
-	switch (mState)
+	size_t lenTickMax = cNumIoBurstMax * pNode->sizeIoMax;
+	size_t lenTick = 0;
+	ssize_t lenDone;
+
+	while (lenTick < lenTickMax)
 	{
-	case StSdStart:
+		lenDone = sinkKernelMove(pNode, lenTickMax - lenTick);
+		if (!lenDone)
+			return;
 
-		if (mIsInternal)
+		if (lenDone < 0)
 		{
-			mState = StSdInternals;
-			break;
+			procDbgLog("end-of-file");
+			fdClose(pNode->pipe.fdRead);
+
+			autoSinkDone(pNode);
+			return;
 		}
 
-		mState = StSdContainer;
+		lenTick += lenDone;
+		mBytesRead += lenDone;
+		bytesCount(pNode, lenDone);
 
-		break;
-	case StSdContainer:
+		if (!pNode->kernelIo)
+			return;
+	}
+}
 
-		mState = StSdInternalsFree;
+/*
+ * All sinks are descriptors. The last one consumes the data
+ * using splice(). All others receive a copy using tee(),
+ * which requires them to be pipes. The amount is limited by
+ * the free space of the sink pipes.
+ * The capacity of a pipe is counted in buffer slots, not in bytes.
+ * If a sink accepts less than planned anyway, kernel I/O is left
+ * and the remainder is delivered using the sink queues.
+ *
+ * Returns
+ * - > 0: Number of bytes moved
+ * - = 0: Nothing moved at the moment
+ * - < 0: End of file
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man2/tee.2.html
+ */
+ssize_t FileExecuting::sinkKernelMove(FeNode *pNode, size_t lenMax)
+{
+#if defined(__linux__)
+	int fdSrc = pNode->pipe.fdRead;
+	list<FeFileDescSetting>::iterator iFd, iLast;
+	struct pollfd pfd;
+	size_t lenMove, lenMoved;
+	int lenAvail, lenUsed;
+	ssize_t res;
+	struct stat st;
+	vector<size_t> lensTee;
 
-		break;
-	case StSdInternalsFree:
+	if (!mReadReady || fdSrc < 0)
+		return 0;
 
-		if (mInternalsStarted)
-			return Positive;
+	res = ioctl(fdSrc, FIONREAD, &lenAvail);
+	if (res < 0)
+		lenAvail = 0;
 
-		iter = mLstExec.begin();
-		for (; iter != mLstExec.end(); ++iter)
-			delete *iter;
+	if (!lenAvail)
+	{
+		pfd.fd = fdSrc;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
 
-		return Positive;
+		res = poll(&pfd, 1, 0);
 
-		break;
-	case StSdInternals:
+		if (res > 0 && (pfd.revents & POLLHUP) && !(pfd.revents & POLLIN))
+			return -1;
 
-		mState = StSdPipesClose;
+		// Pipe may be kept open by descendants of the child
+		if (mpResult->childTerminated && !(pfd.revents & POLLIN))
+			return -1;
 
-		break;
-	case StSdPipesClose:
+		return 0;
+	}
 
-		pipeClose(mNodeIn.pipe);
-		pipeClose(mNodeOut.pipe);
-		pipeClose(mNodeErr.pipe);
+	lenMove = PMIN((size_t)lenAvail, lenMax);
 
-		return Positive;
+	iLast = pNode->lstFds.end();
+	--iLast;
 
-		break;
-	case StSdTmp:
+	iFd = pNode->lstFds.begin();
+	for (; iFd != pNode->lstFds.end(); ++iFd)
+	{
+		if (fstat(iFd->fd, &st) || !S_ISFIFO(st.st_mode))
+			continue;
 
-		break;
-	default:
-		mState = StSdStart;
-		break;
+		res = ioctl(iFd->fd, FIONREAD, &lenUsed);
+		if (res < 0)
+			lenUsed = 0;
+
+		lenMove = PMIN(lenMove, pipeSizeGet(iFd->fd) - lenUsed);
 	}
 
-	return Pending;
-}
+	if (!lenMove)
+		return 0; // Sinks full
 
-FileExecuting &FileExecuting::msTimeoutSet(uint32_t msTimeout)
-{
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxConfig);
-#endif
-	if (mConfigClosed)
-		return *this;
+	for (iFd = pNode->lstFds.begin(); iFd != iLast; ++iFd)
+	{
+		do
+			res = tee(fdSrc, iFd->fd, lenMove, SPLICE_F_NONBLOCK);
+		while (res < 0 && errno == EINTR);
 
-	mMsTimeout = msTimeout;
+		if (res < 0 && errno == EINVAL && iFd == pNode->lstFds.begin())
+		{
+			pNode->kernelIo = false;
+			return 0;
+		}
 
-	return *this;
-}
+		if (res == (ssize_t)lenMove)
+		{
+			lensTee.push_back(lenMove);
+			continue;
+		}
 
-FileExecuting &FileExecuting::sourceEnable()
-{
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxConfig);
-#endif
-	if (mConfigClosed)
-		return *this;
+		// Sinks following this one didn't receive anything
+		lensTee.push_back(res > 0 ? res : 0);
+		lensTee.resize(pNode->lstFds.size(), 0);
 
-	mNodeIn.manualEnabled = true;
+		procDbgLog("tee() incomplete. Sink %d. Leaving kernel I/O", iFd->fd);
 
-	return *this;
-}
+		return kernelIoLeave(pNode, lenMove, lensTee);
+	}
 
-FileExecuting &FileExecuting::sourceSet(const char *pSrc, size_t len, bool autoFree)
-{
-	if (!pSrc)
-		return *this;
+	lenMoved = 0;
 
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxConfig);
-#endif
-	if (mConfigClosed)
-		return *this;
+	while (lenMoved < lenMove)
+	{
+		res = splice(fdSrc, NULL, iLast->fd, NULL, lenMove - lenMoved,
+				SPLICE_F_NONBLOCK | SPLICE_F_MOVE);
 
-	if (mNodeIn.lstBuffers.size())
-		mNodeIn.lstBuffers.clear();
+		if (res < 0 && errno == EINTR)
+			continue;
 
-	if (!len)
-		len = strlen(pSrc);
+		if (res < 0 && errno == EINVAL && pNode->lstFds.size() == 1)
+		{
+			procDbgLog("splice() not supported by sink. Using write()");
+			pNode->kernelIo = false;
+			return 0;
+		}
 
-	mNodeIn.lstBuffers.emplace_back(pSrc, nullptr, len, autoFree);
-	mNodeIn.autoEnabled = true;
+		if (res < 0 && errno != EAGAIN)
+		{
+			procErrLog(-1, "splice() failed: %s", strerror(errno));
+			return -1;
+		}
 
-	return *this;
-}
+		if (res > 0)
+		{
+			lenMoved += res;
+			continue;
+		}
 
-FileExecuting &FileExecuting::sourceSet(const string *pStr)
-{
-	if (!pStr)
-		return *this;
+		// Sink full
+		if (pNode->lstFds.size() == 1)
+			break;
 
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxConfig);
-#endif
-	if (mConfigClosed)
-		return *this;
+		// The other sinks already have the remainder
+		lensTee.resize(pNode->lstFds.size(), lenMove - lenMoved);
+		lensTee.back() = 0;
 
-	if (mNodeIn.lstBuffers.size())
-		mNodeIn.lstBuffers.clear();
+		procDbgLog("splice() incomplete. Sink %d. Leaving kernel I/O", iLast->fd);
 
-	mNodeIn.lstBuffers.emplace_back(pStr->c_str(), nullptr, pStr->size(), false);
-	mNodeIn.autoEnabled = true;
+		res = kernelIoLeave(pNode, lenMove - lenMoved, lensTee);
+		if (res < 0)
+			return res;
 
-	return *this;
+		return lenMoved + res;
+	}
+
+	return lenMoved;
+#else
+	(void)lenMax;
+	pNode->kernelIo = false;
+	return 0;
+#endif
 }
 
-FileExecuting &FileExecuting::sourceSet(int fd, bool autoClose)
+/*
+ * Data which has been copied using tee() to some of the sinks only
+ * is read and handed over to the sink queues. Each sink gets
+ * the part it didn't receive yet. All further data is
+ * delivered using the sink queues as well.
+ * lensTee: Number of bytes already received by each descriptor
+ */
+ssize_t FileExecuting::kernelIoLeave(FeNode *pNode, size_t len, const vector<size_t> &lensTee)
 {
-	if (fd < 0)
-		return *this;
+	list<FeSinkQueue>::iterator iQueue;
+	vector<char> buf(len);
+	size_t lenDone = 0;
+	ssize_t res;
 
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxConfig);
-#endif
-	if (mConfigClosed)
-		return *this;
+	pNode->kernelIo = false;
 
-	if (mNodeIn.lstFds.size())
-		mNodeIn.lstFds.clear();
+	if (!pNode->queuesCreated)
+		sinkQueuesCreate(pNode);
 
-	mNodeIn.lstFds.emplace_back(fd, autoClose);
-	mNodeIn.autoEnabled = true;
+	while (lenDone < len)
+	{
+		res = ::read(pNode->pipe.fdRead, buf.data() + lenDone, len - lenDone);
+		if (res < 0 && errno == EINTR)
+			continue;
 
-	return *this;
+		if (res <= 0)
+			return procErrLog(-1, "could not read data already copied to sinks");
+
+		lenDone += res;
+	}
+
+	iQueue = pNode->lstQueues.begin();
+	for (size_t i = 0; iQueue != pNode->lstQueues.end() && i < lensTee.size(); ++iQueue, ++i)
+		iQueue->lenTee = lensTee[i];
+
+	sinkQueuesDeliver(pNode, buf.data(), len);
+
+	return len;
 }
 
-FileExecuting &FileExecuting::sourceSet(Transfering *pTrans)
+/*
+ * A regular file as the only source or sink
+ * is handed over to the child directly.
+ * The child then reads or writes the file itself
+ */
+void FileExecuting::nodeDirectSet(FeNode *pNode, bool isSource)
 {
-	if (!pTrans)
-		return *this;
+	FeFileDescSetting *pFd;
+	struct stat st;
+	int fd, res;
 
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxConfig);
-#endif
-	if (mConfigClosed)
-		return *this;
+	if (pNode->manualEnabled || !pNode->autoEnabled)
+		return;
 
-	if (mNodeIn.lstTransfers.size())
-		mNodeIn.lstTransfers.clear();
+	if (pNode->lstFds.size() != 1)
+		return;
 
-	mNodeIn.lstTransfers.push_back(pTrans);
-	mNodeIn.autoEnabled = true;
+	if (nodeHasSinksExtra(pNode) || pNode->lstTransfers.size())
+		return;
 
-	return *this;
-}
+	pFd = &pNode->lstFds.front();
 
-FileExecuting &FileExecuting::cmdAdd(const VecConstChar &argv)
-{
-	size_t argc = argv.size();
+	res = fstat(pFd->fd, &st);
+	if (res < 0 || !S_ISREG(st.st_mode))
+		return;
 
-	if (!argc)
-		return *this;
+	fd = fcntl(pFd->fd, F_DUPFD_CLOEXEC, 3);
+	if (fd < 0)
+		return;
 
-	return intCmdAdd(argv[0], VecConstChar(argv.begin() + 1, argv.end()));
+	if (isSource)
+		pNode->pipe.fdRead = fd;
+	else
+		pNode->pipe.fdWrite = fd;
+
+	if (pFd->autoClose)
+		fdClose(pFd->fd);
+
+	pNode->lstFds.clear();
+	pNode->autoEnabled = false;
+	pNode->direct = true;
 }
 
-FileExecuting &FileExecuting::intCmdAdd(const string &cmd, const VecConstChar &argv)
+void FileExecuting::nodeKernelIoCheck(FeNode *pNode, bool isSource)
 {
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxConfig);
-#endif
-	if (mConfigClosed)
-		return *this;
+#if defined(__linux__)
+	list<FeFileDescSetting>::iterator iFd, iTarget;
+	struct stat st;
+	size_t numOther = 0;
+	int res, flags;
 
-	if (!cmd.size())
-		return *this;
+	pNode->kernelIo = false;
 
-	FileExecuting *pExec = FileExecuting::create();
-	if (!pExec)
+	if (!pNode->autoEnabled || !pNode->lstFds.size())
+		return;
+
+	if (nodeHasSinksExtra(pNode) || pNode->lstTransfers.size())
+		return;
+
+	if (isSource)
 	{
-		procErrLog(-1, "could not create process");
-		return *this;
+		pNode->kernelIo = pNode->lstFds.size() == 1;
+		return;
 	}
 
-	pExec->mIsInternal = true;
+	// Sinks: At most one descriptor may be something other than a pipe
+	iTarget = pNode->lstFds.end();
 
-	pExec->mCmd = cmd;
+	iFd = pNode->lstFds.begin();
+	for (; iFd != pNode->lstFds.end(); ++iFd)
+	{
+		res = fstat(iFd->fd, &st);
+		if (res < 0)
+			return;
 
-	size_t pos;
+		if (S_ISFIFO(st.st_mode))
+			continue;
 
-	pos = cmd.find_last_of("/\\");
-	if (pos == string::npos)
-		pExec->mCmdBase = cmd;
-	else
-		pExec->mCmdBase = cmd.substr(pos + 1);
+		if (!S_ISREG(st.st_mode))
+			return;
 
-	pExec->mArgs.clear();
-	pExec->mArgs.push_back(pExec->mCmd.c_str());
-	pExec->mArgs.insert(pExec->mArgs.end(), argv.begin(), argv.end());
+		// splice() to files opened with O_APPEND fails
+		flags = fcntl(iFd->fd, F_GETFL);
+		if (flags < 0 || (flags & O_APPEND))
+			return;
 
-	pExec->mEnv.clear();
-	pExec->mEnv.reserve(8);
+		iTarget = iFd;
+		++numOther;
+	}
 
-	mLstExec.push_back(pExec);
+	if (numOther > 1)
+		return;
 
-	size_t numCmd = mLstExec.size();
+	// The descriptor consuming the data using splice() must be the last one
+	if (iTarget != pNode->lstFds.end())
+		pNode->lstFds.splice(pNode->lstFds.end(), pNode->lstFds, iTarget);
 
-	if (numCmd < 2)
-		return *this;
+	pNode->kernelIo = true;
+#else
+	(void)pNode;
+	(void)isSource;
+#endif
+}
 
-	// Do not use reversed linking!
-	// Reason: pPrev would be in manual read() mode otherwise
+/*
+ * Data is only appended within the capacity of the last chunk.
+ * Chunks therefore never move in memory. The size of new chunks
+ * grows with the amount of data captured so far
+ */
+void FileExecuting::captureAppend(FeCapture *pCapture, const char *pData, size_t len)
+{
+	size_t lenFree, lenPlanned, sizeChunk;
+	string *pChunk;
 
-	pExec->sourceEnable();
+	while (len)
+	{
+		pChunk = pCapture->chunks.size() ? &pCapture->chunks.back() : NULL;
+		lenFree = pChunk ? pChunk->capacity() - pChunk->size() : 0;
 
-	FileExecuting *pPrev = mLstExec[numCmd - 2];
-	FeNode *pNode = &pPrev->mNodeOut;
+		if (!lenFree)
+		{
+			if (pCapture->chunks.empty() && pCapture->sizeHint)
+				sizeChunk = pCapture->sizeHint;
+			else
+				sizeChunk = PMIN(PMAX(pCapture->len, cSizeChunkMin), cSizeChunkMax);
 
-	pNode->lstTransfers.push_back(pExec);
-	pNode->autoEnabled = true;
+			pCapture->chunks.emplace_back();
+			pChunk = &pCapture->chunks.back();
+			pChunk->reserve(PMAX(sizeChunk, len));
 
-	return *this;
+			lenFree = pChunk->capacity();
+		}
+
+		lenPlanned = PMIN(len, lenFree);
+		pChunk->append(pData, lenPlanned);
+
+		pCapture->len += lenPlanned;
+		pData += lenPlanned;
+		len -= lenPlanned;
+	}
 }
 
-FileExecuting &FileExecuting::envSet(const VecConstChar &envv, bool dropOld)
+bool FileExecuting::nodeHasSinksExtra(const FeNode *pNode) const
 {
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxConfig);
-#endif
-	if (mConfigClosed)
-		return *this;
+	return pNode->lstBuffers.size() || pNode->lstStrings.size() || pNode->pCapture;
+}
 
-	int idx = mLstExec.size();
-	if (!idx)
-		return *this;
-	--idx;
+/*
+ * Descriptors and Transfering() processes may accept only
+ * parts of the data. Each of them gets its own queue.
+ * Other sinks are not stalled by a slow one
+ */
+void FileExecuting::sinkQueuesCreate(FeNode *pNode)
+{
+	list<FeFileDescSetting>::iterator iFd;
+	list<Transfering *>::iterator iTrans;
+	FeSinkQueue queue;
+	struct stat st;
+	int res;
 
-	FileExecuting *pExec = mLstExec[idx];
+	queue.fd = -1;
+	queue.pTrans = NULL;
+	queue.tee = false;
+	queue.failed = false;
+	queue.lenTee = 0;
+	queue.lenQueued = 0;
 
-	for (char **pEnv = environ; (!dropOld) && *pEnv; ++pEnv)
-		pExec->mEnv.push_back(*pEnv);
+	iFd = pNode->lstFds.begin();
+	for (; iFd != pNode->lstFds.end(); ++iFd)
+	{
+		queue.fd = iFd->fd;
+#if defined(__linux__)
+		res = fstat(queue.fd, &st);
+		queue.tee = !res && S_ISFIFO(st.st_mode);
+#else
+		(void)res;
+		(void)st;
+#endif
+		pNode->lstQueues.push_back(queue);
+	}
 
-	pExec->mEnv.insert(pExec->mEnv.end(), envv.begin(), envv.end());
-	pExec->mUserEnv = true;
+	queue.fd = -1;
+	queue.tee = false;
 
-	return *this;
+	iTrans = pNode->lstTransfers.begin();
+	for (; iTrans != pNode->lstTransfers.end(); ++iTrans)
+	{
+		queue.pTrans = *iTrans;
+		pNode->lstQueues.push_back(queue);
+	}
+
+	pNode->queuesCreated = true;
 }
 
-FileExecuting &FileExecuting::sinkEnable(int fdSel)
+void FileExecuting::sinkQueuesFlush(FeNode *pNode)
 {
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxConfig);
-#endif
-	if (mConfigClosed)
-		return *this;
+	list<FeSinkQueue>::iterator iQueue;
+	FeSinkQueue *pQueue;
+	FeChunkRef *pRef;
+	ssize_t lenDone;
+	size_t len;
+
+	iQueue = pNode->lstQueues.begin();
+	for (; iQueue != pNode->lstQueues.end(); ++iQueue)
+	{
+		pQueue = &(*iQueue);
 
-	int idx = mLstExec.size();
-	if (!idx)
-		return *this;
-	--idx;
+		while (pQueue->chunks.size())
+		{
+			pRef = &pQueue->chunks.front();
+			len = pRef->pChunk->size() - pRef->offs;
 
-	FileExecuting *pExec = mLstExec[idx];
-	FeNode *pNode = fdSel == STDOUT_FILENO ? &pExec->mNodeOut : &pExec->mNodeErr;
+			lenDone = sinkQueueWrite(pQueue, pRef->pChunk->data() + pRef->offs, len);
+			if (lenDone <= 0)
+				break;
 
-	pNode->manualEnabled = true;
+			pRef->offs += lenDone;
+			pQueue->lenQueued -= lenDone;
 
-	return *this;
+			if ((size_t)lenDone < len)
+				break;
+
+			pQueue->chunks.pop_front();
+		}
+	}
 }
 
-FileExecuting &FileExecuting::sinkAdd(char *pDest, size_t len, int fdSel)
+bool FileExecuting::sinkQueuesEmpty(const FeNode *pNode) const
 {
-	if (!pDest)
-		return *this;
-
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxConfig);
-#endif
-	if (mConfigClosed)
-		return *this;
+	list<FeSinkQueue>::const_iterator iQueue;
 
-	int idx = mLstExec.size();
-	if (!idx)
-		return *this;
-	--idx;
-
-	FileExecuting *pExec = mLstExec[idx];
-	FeNode *pNode = fdSel == STDOUT_FILENO ? &pExec->mNodeOut : &pExec->mNodeErr;
-
-	pNode->lstBuffers.emplace_back(nullptr, pDest, len, false);
-	pNode->autoEnabled = true;
+	iQueue = pNode->lstQueues.begin();
+	for (; iQueue != pNode->lstQueues.end(); ++iQueue)
+	{
+		if (iQueue->lenQueued)
+			return false;
+	}
 
-	return *this;
+	return true;
 }
 
-FileExecuting &FileExecuting::sinkAdd(string *pStr, int fdSel)
+size_t FileExecuting::sinkQueuesLen(const FeNode *pNode) const
 {
-	if (!pStr)
-		return *this;
+	list<FeSinkQueue>::const_iterator iQueue;
+	size_t len = 0;
 
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxConfig);
-#endif
-	if (mConfigClosed)
-		return *this;
+	iQueue = pNode->lstQueues.begin();
+	for (; iQueue != pNode->lstQueues.end(); ++iQueue)
+		len += iQueue->lenQueued;
 
-	int idx = mLstExec.size();
-	if (!idx)
-		return *this;
-	--idx;
+	return len;
+}
 
-	FileExecuting *pExec = mLstExec[idx];
-	FeNode *pNode = fdSel == STDOUT_FILENO ? &pExec->mNodeOut : &pExec->mNodeErr;
+/*
+ * A queue may exceed the limit by at most one read
+ */
+bool FileExecuting::sinkQueuesFull(const FeNode *pNode) const
+{
+	list<FeSinkQueue>::const_iterator iQueue;
 
-	pNode->lstStrings.push_back(pStr);
-	pNode->autoEnabled = true;
+	iQueue = pNode->lstQueues.begin();
+	for (; iQueue != pNode->lstQueues.end(); ++iQueue)
+	{
+		if (iQueue->lenQueued >= cSizeSinkQueueMax)
+			return true;
+	}
 
-	return *this;
+	return false;
 }
 
-FileExecuting &FileExecuting::sinkAdd(int fd, bool autoClose, int fdSel)
+/*
+ * Pipes with an empty queue receive the next data
+ * using tee() before it is read by this process.
+ * Returns the number of bytes which must be read then.
+ * 0: No sink served by tee()
+ */
+size_t FileExecuting::sinkQueuesTee(FeNode *pNode, size_t lenMax)
 {
-	if (fd < 0)
+#if defined(__linux__)
+	list<FeSinkQueue>::iterator iQueue;
+	FeSinkQueue *pQueue;
+	size_t lenReq = 0;
+	int lenAvail = 0;
+	ssize_t res;
+
+	iQueue = pNode->lstQueues.begin();
+	for (; iQueue != pNode->lstQueues.end(); ++iQueue)
 	{
-		procErrLog(-1, "could not add fd sink. Invalid fd");
-		return *this;
+		pQueue = &(*iQueue);
+
+		pQueue->lenTee = 0;
+
+		if (!pQueue->tee || pQueue->failed || pQueue->chunks.size())
+			continue;
+
+		if (!lenReq)
+		{
+			res = ioctl(pNode->pipe.fdRead, FIONREAD, &lenAvail);
+			if (res < 0 || lenAvail <= 0)
+				return 0;
+
+			lenReq = PMIN((size_t)lenAvail, lenMax);
+		}
+
+		res = tee(pNode->pipe.fdRead, pQueue->fd, lenReq, SPLICE_F_NONBLOCK);
+		if (res < 0 && errno == EINVAL)
+			pQueue->tee = false;
+
+		if (res > 0)
+			pQueue->lenTee = res;
 	}
 
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxConfig);
+	return lenReq;
+#else
+	(void)pNode;
+	(void)lenMax;
+	return 0;
 #endif
-	if (mConfigClosed)
-		return *this;
+}
 
-	int idx = mLstExec.size();
-	if (!idx)
-		return *this;
-	--idx;
+/*
+ * Sinks which don't accept all data reference the remainder.
+ * The data is copied at most once per read,
+ * independent of the number of sinks lagging behind
+ */
+void FileExecuting::sinkQueuesDeliver(FeNode *pNode, const char *pBuf, size_t len)
+{
+	list<FeSinkQueue>::iterator iQueue;
+	FeSinkQueue *pQueue;
+	FeChunkPtr pChunk;
+	FeChunkRef ref;
+	ssize_t lenDone;
+	size_t offs;
+
+	iQueue = pNode->lstQueues.begin();
+	for (; iQueue != pNode->lstQueues.end(); ++iQueue)
+	{
+		pQueue = &(*iQueue);
 
-	FileExecuting *pExec = mLstExec[idx];
-	FeNode *pNode = fdSel == STDOUT_FILENO ? &pExec->mNodeOut : &pExec->mNodeErr;
+		offs = PMIN(pQueue->lenTee, len);
+		pQueue->lenTee = 0;
 
-	pNode->lstFds.emplace_back(fd, autoClose);
-	pNode->autoEnabled = true;
+		if (pQueue->failed || offs == len)
+			continue;
 
-	return *this;
+		if (!pQueue->chunks.size())
+		{
+			lenDone = sinkQueueWrite(pQueue, pBuf + offs, len - offs);
+			if (lenDone < 0)
+				continue;
+
+			offs += lenDone;
+		}
+
+		if (offs == len)
+			continue;
+
+		if (!pChunk)
+			pChunk = make_shared<const vector<char> >(pBuf, pBuf + len);
+
+		ref.pChunk = pChunk;
+		ref.offs = offs;
+
+		pQueue->chunks.push_back(ref);
+		pQueue->lenQueued += len - offs;
+	}
 }
 
-FileExecuting &FileExecuting::sinkAdd(Transfering *pTrans, int fdSel)
+/*
+ * Returns
+ * - >= 0: Number of bytes accepted by the sink
+ * - < 0: Sink failed. Not used anymore
+ */
+ssize_t FileExecuting::sinkQueueWrite(FeSinkQueue *pQueue, const char *pData, size_t len)
 {
-	if (!pTrans)
-		return *this;
+	ssize_t res;
 
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxConfig);
-#endif
-	if (mConfigClosed)
-		return *this;
+	if (pQueue->pTrans)
+		res = pQueue->pTrans->send(pData, len);
+	else
+	{
+		do
+			res = ::write(pQueue->fd, pData, len);
+		while (res < 0 && errno == EINTR);
 
-	int idx = mLstExec.size();
-	if (!idx)
-		return *this;
-	--idx;
+		if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 0;
+	}
 
-	FileExecuting *pExec = mLstExec[idx];
-	FeNode *pNode = fdSel == STDOUT_FILENO ? &pExec->mNodeOut : &pExec->mNodeErr;
+	if (res >= 0)
+		return res;
 
-	pNode->lstTransfers.push_back(pTrans);
-	pNode->autoEnabled = true;
+	procErrLog(-1, "could not write to sink. Dropping data");
 
-	return *this;
+	pQueue->failed = true;
+	pQueue->chunks.clear();
+	pQueue->lenQueued = 0;
+
+	return -1;
 }
 
-FileExecuting &FileExecuting::errRedirect()
+void FileExecuting::bufIoPrepare(FeNode *pNode)
 {
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxConfig);
-#endif
-	if (mConfigClosed)
-		return *this;
+	if (!pNode->sizeIoMax)
+		pNode->sizeIoMax = cSizeIoMaxDefault;
 
-	int idx = mLstExec.size();
-	if (!idx)
-		return *this;
-	--idx;
+	if (pNode->bufIo.size())
+		return;
 
-	FileExecuting *pExec = mLstExec[idx];
+	pNode->bufIo.resize(PMIN(cSizeIoInit, pNode->sizeIoMax));
+}
 
-	pExec->mNodeErr.redirect = true;
+/*
+ * A completely filled buffer indicates more data.
+ * The buffer is doubled until it reaches the capacity of the pipe
+ */
+void FileExecuting::bufIoAdapt(FeNode *pNode, size_t lenDone)
+{
+	size_t sizeBuf = pNode->bufIo.size();
 
-	return *this;
+	if (lenDone < sizeBuf)
+		return;
+
+	if (sizeBuf >= pNode->sizeIoMax)
+		return;
+
+	pNode->bufIo.resize(PMIN(sizeBuf << 1, pNode->sizeIoMax));
 }
 
-int FileExecuting::sigSend(int sig, ssize_t idx) const
+/*
+ * Arguments and environment are copied into a single allocation.
+ * Layout: [argv pointers][NULL][envp pointers][NULL][strings]
+ */
+bool FileExecuting::argsArenaCreate()
 {
-	// internal
+	size_t numArgs = mArgs.size();
+	size_t numEnv = mEnv.size();
+	size_t sizePtrs = (numArgs + 1 + numEnv + 1) * sizeof(char *);
+	size_t sizeStrs = 0;
+	size_t len;
+	char *pStr;
 
-	if (mIsInternal)
+	for (size_t i = 0; i < numArgs; ++i)
+		sizeStrs += strlen(mArgs[i]) + 1;
+
+	for (size_t i = 0; i < numEnv; ++i)
+		sizeStrs += strlen(mEnv[i]) + 1;
+
+	mpArena = (char *)malloc(sizePtrs + sizeStrs);
+	if (!mpArena)
+		return false;
+
+	mpArgs = (char **)mpArena;
+	mpEnv = mpArgs + numArgs + 1;
+	pStr = mpArena + sizePtrs;
+
+	for (size_t i = 0; i < numArgs; ++i)
 	{
-		if (mpResult->idChild < 0)
-			return procErrLog(-2, "cannot send signal. Child PID not set");
+		len = strlen(mArgs[i]) + 1;
+		memcpy(pStr, mArgs[i], len);
 
-		return kill(mpResult->idChild, sig);
+		mpArgs[i] = pStr;
+		pStr += len;
 	}
 
-	// container - specific internal
+	mpArgs[numArgs] = NULL;
 
-	if (idx >= (ssize_t)mLstExec.size())
-		return procErrLog(-3, "cannot send signal. Index out of bounds");
+	for (size_t i = 0; i < numEnv; ++i)
+	{
+		len = strlen(mEnv[i]) + 1;
+		memcpy(pStr, mEnv[i], len);
 
-	if (idx >= 0)
-		return mLstExec[idx]->sigSend(sig);
+		mpEnv[i] = pStr;
+		pStr += len;
+	}
 
-	// container - all internals
+	mpEnv[numEnv] = NULL;
 
-	if (!mLstExec.size())
-		return procErrLog(-4, "cannot send signal. Empty command list");
+	return true;
+}
 
-	vector<FileExecuting *>::const_iterator iter;
+void FileExecuting::argsArenaFree()
+{
+	free(mpArena);
+
+	mpArena = NULL;
+	mpArgs = NULL;
+	mpEnv = NULL;
+}
+
+/*
+ * Spawns the child without copying the page tables of the parent.
+ * Requires closing all inherited descriptors in the child.
+ * Returns Pending if this is not supported by the C library.
+ * A failed spawn gives the same result as a failed
+ * execvpe() after vfork(): Exit code 1 and a message on stderr
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man3/posix_spawn.3.html
+ * - https://man7.org/linux/man-pages/man3/posix_spawn_file_actions_addclose.3p.html
+ */
+Success FileExecuting::childSpawn()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+	posix_spawn_file_actions_t actions;
+	pid_t idProc;
 	int res;
 
-	idx = 0;
-	iter = mLstExec.begin();
-	for (; iter != mLstExec.end(); ++iter, ++idx)
+	res = posix_spawn_file_actions_init(&actions);
+	if (res)
+		return procErrLog(-1, "could not init file actions: %s", strerror(res));
+
+	res = posix_spawn_file_actions_adddup2(&actions, mNodeErr.pipe.fdWrite, STDERR_FILENO);
+	if (!res)
+		res = posix_spawn_file_actions_adddup2(&actions, mNodeIn.pipe.fdRead, STDIN_FILENO);
+	if (!res)
+		res = posix_spawn_file_actions_adddup2(&actions, mNodeOut.pipe.fdWrite, STDOUT_FILENO);
+	if (!res)
+		res = posix_spawn_file_actions_addclosefrom_np(&actions, 3);
+
+	if (res)
 	{
-		res = (*iter)->sigSend(sig);
-		if (res < 0)
-			return procErrLog(-4, "error sending signal to process. Index %d, PID %d: %s",
-							idx, (*iter)->mpResult->idChild, strerror(errno));
+		posix_spawn_file_actions_destroy(&actions);
+		return procErrLog(-1, "could not add file action: %s", strerror(res));
 	}
 
-	return 0;
-}
+	res = posix_spawnp(&idProc, mpArgs[0], &actions, NULL,
+				mpArgs, mUserEnv ? mpEnv : environ);
 
-bool FileExecuting::boolRet(ssize_t idx, size_t offs, bool isAnd)
-{
+	posix_spawn_file_actions_destroy(&actions);
+
+	if (res)
 	{
-#if CONFIG_PROC_HAVE_DRIVERS
-		Guard lock(mMtxConfig);
-#endif
-		if (!mConfigClosed)
-			return false;
+		dprintf(mNodeErr.pipe.fdWrite, "could not execute file '%s': %s\n",
+				mpArgs[0], strerror(res));
+
+		mStrStateChild = "Terminated by exit()";
+
+		mpResult->idChild = -1;
+		mpResult->childTerminated = true;
+		mpResult->childTerminatedBySig = false;
+		mpResult->codeRet = EXIT_FAILURE;
+
+		return Positive;
 	}
 
-	// container - specific internal
+	mpResult->idChild = idProc;
 
-	if (idx >= (ssize_t)mLstExec.size())
-		return false;
+	return Positive;
+#else
+	procDbgLog("posix_spawn() without closefrom not supported. Using vfork()");
+	mModeSpawn = FeSpawnFork;
 
-	if (idx >= 0)
+	return Pending;
+#endif
+}
+
+/*
+ * The zygote forks the child. This process only sends
+ * the arguments, the environment and the descriptors.
+ * Returns Pending if the zygote is not running or the
+ * request doesn't fit into a single message.
+ * The response is collected by zygoteRspGet()
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man7/unix.7.html
+ * - https://man7.org/linux/man-pages/man3/cmsg.3.html
+ */
+Success FileExecuting::zygoteSpawn()
+{
+#if defined(__linux__)
+	char bufCtrl[CMSG_SPACE(cNumZygoteFdsMax * sizeof(int))];
+	vector<char> bufReq;
+	FeZygoteReq req;
+	char **ppEnv = mUserEnv ? mpEnv : environ;
+	struct cmsghdr *pCmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	int fds[cNumZygoteFdsMax];
+	size_t lenRlimits, len;
+	ssize_t res;
+
+	memset(&req, 0, sizeof(req));
+
+	for (; mpArgs[req.numArgs]; ++req.numArgs)
+		req.lenStrs += strlen(mpArgs[req.numArgs]) + 1;
+
+	for (; ppEnv && ppEnv[req.numEnv]; ++req.numEnv)
+		req.lenStrs += strlen(ppEnv[req.numEnv]) + 1;
+
+	req.numRlimits = mRlimits.size();
+	lenRlimits = req.numRlimits * sizeof(FeRlimit);
+
+	len = sizeof(req) + lenRlimits + req.lenStrs;
+	if (len > cSizeZygoteMsgMax)
 	{
-		bool *pBool = &mResults[idx].childStopped;
-		pBool += offs;
-		return *pBool;
+		procDbgLog("arguments too large for zygote. Using vfork()");
+		mModeSpawn = FeSpawnFork;
+		return Pending;
 	}
 
-	// container - all internals
+	fds[0] = mNodeIn.pipe.fdRead;
+	fds[1] = mNodeOut.pipe.fdWrite;
+	fds[2] = mNodeErr.pipe.fdWrite;
+	req.numFds = 3;
 
-	bool checkRes;
+	if (mFdCgroupProcs >= 0)
+		fds[req.numFds++] = mFdCgroupProcs;
 
-	for (size_t i = 0; i < mResults.size(); ++i)
+	bufReq.resize(len);
+
+	memcpy(bufReq.data(), &req, sizeof(req));
+	if (lenRlimits)
+		memcpy(bufReq.data() + sizeof(req), mRlimits.data(), lenRlimits);
+
+	len = sizeof(req) + lenRlimits;
+
+	for (uint32_t i = 0; i < req.numArgs; ++i)
 	{
-		checkRes = boolRet(i, offs, false);
+		memcpy(bufReq.data() + len, mpArgs[i], strlen(mpArgs[i]) + 1);
+		len += strlen(mpArgs[i]) + 1;
+	}
 
-		if (isAnd xor checkRes)
-			return checkRes;
+	for (uint32_t i = 0; i < req.numEnv; ++i)
+	{
+		memcpy(bufReq.data() + len, ppEnv[i], strlen(ppEnv[i]) + 1);
+		len += strlen(ppEnv[i]) + 1;
 	}
 
-	return isAnd;
-}
+	iov.iov_base = bufReq.data();
+	iov.iov_len = len;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(bufCtrl, 0, sizeof(bufCtrl));
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = bufCtrl;
+	msg.msg_controllen = CMSG_SPACE(req.numFds * sizeof(int));
+
+	pCmsg = CMSG_FIRSTHDR(&msg);
+	pCmsg->cmsg_level = SOL_SOCKET;
+	pCmsg->cmsg_type = SCM_RIGHTS;
+	pCmsg->cmsg_len = CMSG_LEN(req.numFds * sizeof(int));
+	memcpy(CMSG_DATA(pCmsg), fds, req.numFds * sizeof(int));
 
-int FileExecuting::intRet(ssize_t idx, size_t offs)
-{
 	{
 #if CONFIG_PROC_HAVE_DRIVERS
-		Guard lock(mMtxConfig);
+		Guard lock(mMtxZygote);
 #endif
-		if (!mConfigClosed)
-			return false;
-	}
+		if (mFdZygote < 0)
+		{
+			procDbgLog("zygote not running. Using vfork()");
+			mModeSpawn = FeSpawnFork;
+			return Pending;
+		}
 
-	// container - specific internal
+		req.idReq = mIdZygoteReqNext++;
+		memcpy(bufReq.data(), &req, sizeof(req));
 
-	if (idx >= (ssize_t)mLstExec.size())
-		return procErrLog(-1, "index out of bounds");
+		do
+			res = sendmsg(mFdZygote, &msg, MSG_NOSIGNAL);
+		while (res < 0 && errno == EINTR);
 
-	if (idx >= 0)
-	{
-		int *pInt = &mResults[idx].idChild;
-		pInt += offs;
-		return *pInt;
-	}
+		if (res < 0)
+		{
+			procWrnLog("could not send request to zygote: %s", strerror(errno));
+			zygoteLost();
+
+			mModeSpawn = FeSpawnFork;
+			return Pending;
+		}
+	}
+
+	mIdZygoteReq = req.idReq;
+	mMsZygoteReq = millis();
+	mZygoteReqOpen = true;
+
+	return Positive;
+#else
+	mModeSpawn = FeSpawnFork;
+	return Pending;
+#endif
+}
+
+/*
+ * The mutex is not held between the checks.
+ * Responses are matched using the ID of the request, so any
+ * process may receive the response of another one.
+ * The pipes have been passed to the zygote already.
+ * Therefore the spawn fails if the zygote doesn't respond
+ * in time. Falling back to vfork() would let two children
+ * share the pipes
+ */
+Success FileExecuting::zygoteRspGet()
+{
+	map<uint32_t, FeZygoteMsg>::iterator iter;
+	FeZygoteMsg msgRsp;
+
+	{
+#if CONFIG_PROC_HAVE_DRIVERS
+		Guard lock(mMtxZygote);
+#endif
+		zygoteMsgsDrain();
+
+		iter = mZygoteSpawns.find(mIdZygoteReq);
+		if (iter == mZygoteSpawns.end())
+		{
+			if (mFdZygote < 0)
+			{
+				mZygoteReqOpen = false;
+				return procErrLog(-1, "zygote lost while spawning");
+			}
+
+			if (millis() - mMsZygoteReq < cMsZygoteRspMax)
+				return Pending;
+		}
+		else
+		{
+			msgRsp = iter->second;
+			mZygoteSpawns.erase(iter);
+			mZygoteReqOpen = false;
+		}
+	}
+
+	if (mZygoteReqOpen)
+	{
+		zygoteReqAbandon();
+		return procErrLog(-1, "no response from zygote");
+	}
+
+	if (msgRsp.err)
+		return procErrLog(-1, "could not spawn file '%s' using zygote: %s",
+						mCmdBase.c_str(), strerror(msgRsp.err));
+
+	mpResult->idChild = msgRsp.idProc;
+	mSpawnedByZygote = true;
+
+	return Positive;
+}
+
+/*
+ * A child spawned after the request has been
+ * abandoned is killed by zygoteMsgRecv()
+ */
+void FileExecuting::zygoteReqAbandon()
+{
+	map<uint32_t, FeZygoteMsg>::iterator iter;
+
+	if (!mZygoteReqOpen || mZygoteReqAbandoned)
+		return;
+
+	mZygoteReqAbandoned = true;
+	mMsZygoteReq = millis();
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxZygote);
+#endif
+	zygoteMsgsDrain();
+
+	iter = mZygoteSpawns.find(mIdZygoteReq);
+	if (iter == mZygoteSpawns.end())
+	{
+		if (mFdZygote >= 0)
+			mZygoteReqsAbandoned.insert(mIdZygoteReq);
+		else
+			mZygoteReqOpen = false;
+
+		return;
+	}
+
+	if (iter->second.idProc > 0)
+	{
+		kill(iter->second.idProc, SIGKILL);
+		mZygoteIdsAbandoned.insert(iter->second.idProc);
+	}
+
+	mZygoteSpawns.erase(iter);
+	mZygoteReqOpen = false;
+}
+
+/*
+ * True until the response to an abandoned
+ * request has been received
+ */
+bool FileExecuting::zygoteReqPending()
+{
+	if (!mZygoteReqOpen)
+		return false;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxZygote);
+#endif
+	zygoteMsgsDrain();
+
+	// Also cleared when the zygote is lost
+	if (!mZygoteReqsAbandoned.count(mIdZygoteReq))
+		mZygoteReqOpen = false;
+
+	return mZygoteReqOpen;
+}
+
+/*
+ * Children of the zygote can't be waited for by this process.
+ * Their termination is reported by the zygote instead.
+ * Stop and continue are not reported
+ */
+Success FileExecuting::zygoteStateGet(int &code, int &status)
+{
+	map<int, FeZygoteExit>::iterator iter;
+	int res;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxZygote);
+#endif
+	zygoteMsgsDrain();
+
+	iter = mZygoteExits.find(mpResult->idChild);
+	if (iter == mZygoteExits.end())
+	{
+		if (mFdZygote >= 0)
+			return Pending;
+
+		return procErrLog(-1, "zygote lost. State of child unknown");
+	}
+
+	res = iter->second.status;
+	mpResult->usage = iter->second.usage;
+
+	mZygoteExits.erase(iter);
+	mSpawnedByZygote = false;
+
+	if (WIFSIGNALED(res))
+	{
+		code = WCOREDUMP(res) ? CLD_DUMPED : CLD_KILLED;
+		status = WTERMSIG(res);
+	}
+	else
+	{
+		code = CLD_EXITED;
+		status = WEXITSTATUS(res);
+	}
+
+	return Positive;
+}
+
+/*
+ * The exit of a child which is not waited for anymore
+ * must not stay in the list of reported exits
+ */
+void FileExecuting::zygoteChildRelease()
+{
+	map<int, FeZygoteExit>::iterator iter;
+
+	if (!mSpawnedByZygote || mpResult->idChild <= 0)
+		return;
+
+	mSpawnedByZygote = false;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxZygote);
+#endif
+	iter = mZygoteExits.find(mpResult->idChild);
+	if (iter != mZygoteExits.end())
+	{
+		mZygoteExits.erase(iter);
+		return;
+	}
+
+	if (mFdZygote >= 0)
+		mZygoteIdsAbandoned.insert(mpResult->idChild);
+}
+
+Success FileExecuting::shutdown()
+{
+	//uint32_t curTimeMs = millis();
+	//uint32_t diffMs = curTimeMs - mMsStart;
+	//Success success;
+	//int res;
+	vector<FileExecuting *>::iterator iter;
+#if 0
+	procWrnLog("mState = %s", ProcStateString[mState]);
+#endif
+	switch (mState)
+	{
+	case StSdStart:
+
+		if (mIsInternal)
+		{
+			mState = StSdInternals;
+			break;
+		}
+
+		mState = StSdContainer;
+
+		break;
+	case StSdContainer:
+
+		fdClose(mFdEpoll);
+		cgroupRemove();
+
+		mState = StSdInternalsFree;
+
+		break;
+	case StSdInternalsFree:
+
+		if (mInternalsStarted)
+			return Positive;
+
+		iter = mLstExec.begin();
+		for (; iter != mLstExec.end(); ++iter)
+			delete *iter;
+
+		return Positive;
+
+		break;
+	case StSdInternals:
+
+		// The pipes must not be closed before the child is killed
+		zygoteReqAbandon();
+
+		mState = StSdZygoteRspWait;
+
+		break;
+	case StSdZygoteRspWait:
+
+		if (zygoteReqPending())
+		{
+			if (millis() - mMsZygoteReq < cMsZygoteRspMax)
+				break;
+
+			procWrnLog("no response from zygote. Closing pipes");
+		}
+
+		mState = StSdPipesClose;
+
+		break;
+	case StSdPipesClose:
+
+		pipeClose(mNodeIn.pipe);
+		pipeClose(mNodeOut.pipe);
+		pipeClose(mNodeErr.pipe);
+
+		fdClose(mFdPid);
+		zygoteChildRelease();
+
+		return Positive;
+
+		break;
+	case StSdTmp:
+
+		break;
+	default:
+		mState = StSdStart;
+		break;
+	}
+
+	return Pending;
+}
+
+/*
+ * Wall clock timeout for the whole command chain.
+ * 0: No timeout
+ */
+FileExecuting &FileExecuting::msTimeoutSet(uint32_t msTimeout, uint32_t msKillDelay)
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	mMsTimeout = msTimeout;
+	mMsKillDelay = msKillDelay;
+
+	return *this;
+}
+
+/*
+ * All commands are placed in a new cgroup below dirParent.
+ * Controllers must be enabled in cgroup.subtree_control of dirParent.
+ * 0: No limit
+ */
+FileExecuting &FileExecuting::cgroupSet(const string &dirParent,
+				uint64_t sizeMemMax, uint32_t cpuPercentMax)
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	mDirCgroupParent = dirParent;
+	mSizeMemMax = sizeMemMax;
+	mCpuPercentMax = cpuPercentMax;
+
+	return *this;
+}
+
+/*
+ * Requested capacity of the pipes in bytes (Linux only).
+ * The I/O buffers grow up to the capacity of the pipe.
+ * 0: Default of the system
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man7/pipe.7.html
+ */
+FileExecuting &FileExecuting::pipeSizeSet(size_t sizePipe)
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	mSizePipe = sizePipe;
+
+	return *this;
+}
+
+/*
+ * FeSpawnPosix is recommended when launching many short
+ * lived commands from a parent with a large memory footprint
+ */
+FileExecuting &FileExecuting::spawnModeSet(FeSpawnMode mode)
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	mModeSpawn = mode;
+
+	return *this;
+}
+
+FileExecuting &FileExecuting::sourceEnable()
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	mNodeIn.manualEnabled = true;
+
+	return *this;
+}
+
+FileExecuting &FileExecuting::sourceSet(const char *pSrc, size_t len, bool autoFree)
+{
+	if (!pSrc)
+		return *this;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	if (mNodeIn.lstBuffers.size())
+		mNodeIn.lstBuffers.clear();
+
+	if (!len)
+		len = strlen(pSrc);
+
+	mNodeIn.lstBuffers.emplace_back(pSrc, nullptr, len, autoFree);
+	mNodeIn.autoEnabled = true;
+
+	return *this;
+}
+
+FileExecuting &FileExecuting::sourceSet(const string *pStr)
+{
+	if (!pStr)
+		return *this;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	if (mNodeIn.lstBuffers.size())
+		mNodeIn.lstBuffers.clear();
+
+	mNodeIn.lstBuffers.emplace_back(pStr->c_str(), nullptr, pStr->size(), false);
+	mNodeIn.autoEnabled = true;
+
+	return *this;
+}
+
+FileExecuting &FileExecuting::sourceSet(int fd, bool autoClose)
+{
+	if (fd < 0)
+		return *this;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	if (mNodeIn.lstFds.size())
+		mNodeIn.lstFds.clear();
+
+	mNodeIn.lstFds.emplace_back(fd, autoClose);
+	mNodeIn.autoEnabled = true;
+
+	return *this;
+}
+
+FileExecuting &FileExecuting::sourceSet(Transfering *pTrans)
+{
+	if (!pTrans)
+		return *this;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	if (mNodeIn.lstTransfers.size())
+		mNodeIn.lstTransfers.clear();
+
+	mNodeIn.lstTransfers.push_back(pTrans);
+	mNodeIn.autoEnabled = true;
+
+	return *this;
+}
+
+FileExecuting &FileExecuting::cmdAdd(const VecConstChar &argv)
+{
+	size_t argc = argv.size();
+
+	if (!argc)
+		return *this;
+
+	return intCmdAdd(argv[0], VecConstChar(argv.begin() + 1, argv.end()));
+}
+
+FileExecuting &FileExecuting::intCmdAdd(const string &cmd, const VecConstChar &argv)
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	if (!cmd.size())
+		return *this;
+
+	FileExecuting *pExec = FileExecuting::create();
+	if (!pExec)
+	{
+		procErrLog(-1, "could not create process");
+		return *this;
+	}
+
+	pExec->mIsInternal = true;
+
+	pExec->mCmd = cmd;
+
+	size_t pos;
+
+	pos = cmd.find_last_of("/\\");
+	if (pos == string::npos)
+		pExec->mCmdBase = cmd;
+	else
+		pExec->mCmdBase = cmd.substr(pos + 1);
+
+	pExec->mArgs.clear();
+	pExec->mArgs.push_back(pExec->mCmd.c_str());
+	pExec->mArgs.insert(pExec->mArgs.end(), argv.begin(), argv.end());
+
+	pExec->mEnv.clear();
+	pExec->mEnv.reserve(8);
+
+	mLstExec.push_back(pExec);
+
+	size_t numCmd = mLstExec.size();
+
+	if (numCmd < 2)
+		return *this;
+
+	// Do not use reversed linking!
+	// Reason: pPrev would be in manual read() mode otherwise
+
+	pExec->sourceEnable();
+
+	FileExecuting *pPrev = mLstExec[numCmd - 2];
+	FeNode *pNode = &pPrev->mNodeOut;
+
+	pNode->lstTransfers.push_back(pExec);
+	pNode->autoEnabled = true;
+
+	return *this;
+}
+
+FileExecuting &FileExecuting::envSet(const VecConstChar &envv, bool dropOld)
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	int idx = mLstExec.size();
+	if (!idx)
+		return *this;
+	--idx;
+
+	FileExecuting *pExec = mLstExec[idx];
+
+	for (char **pEnv = environ; (!dropOld) && *pEnv; ++pEnv)
+		pExec->mEnv.push_back(*pEnv);
+
+	pExec->mEnv.insert(pExec->mEnv.end(), envv.begin(), envv.end());
+	pExec->mUserEnv = true;
+
+	return *this;
+}
+
+FileExecuting &FileExecuting::sinkEnable(int fdSel)
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	int idx = mLstExec.size();
+	if (!idx)
+		return *this;
+	--idx;
+
+	FileExecuting *pExec = mLstExec[idx];
+	FeNode *pNode = fdSel == STDOUT_FILENO ? &pExec->mNodeOut : &pExec->mNodeErr;
+
+	pNode->manualEnabled = true;
+
+	return *this;
+}
+
+FileExecuting &FileExecuting::sinkAdd(char *pDest, size_t len, int fdSel)
+{
+	if (!pDest)
+		return *this;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	int idx = mLstExec.size();
+	if (!idx)
+		return *this;
+	--idx;
+
+	FileExecuting *pExec = mLstExec[idx];
+	FeNode *pNode = fdSel == STDOUT_FILENO ? &pExec->mNodeOut : &pExec->mNodeErr;
+
+	pNode->lstBuffers.emplace_back(nullptr, pDest, len, false);
+	pNode->autoEnabled = true;
+
+	return *this;
+}
+
+FileExecuting &FileExecuting::sinkAdd(string *pStr, int fdSel)
+{
+	if (!pStr)
+		return *this;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	int idx = mLstExec.size();
+	if (!idx)
+		return *this;
+	--idx;
+
+	FileExecuting *pExec = mLstExec[idx];
+	FeNode *pNode = fdSel == STDOUT_FILENO ? &pExec->mNodeOut : &pExec->mNodeErr;
+
+	pNode->lstStrings.push_back(pStr);
+	pNode->autoEnabled = true;
+
+	return *this;
+}
+
+FileExecuting &FileExecuting::sinkAdd(int fd, bool autoClose, int fdSel)
+{
+	if (fd < 0)
+	{
+		procErrLog(-1, "could not add fd sink. Invalid fd");
+		return *this;
+	}
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	int idx = mLstExec.size();
+	if (!idx)
+		return *this;
+	--idx;
+
+	FileExecuting *pExec = mLstExec[idx];
+	FeNode *pNode = fdSel == STDOUT_FILENO ? &pExec->mNodeOut : &pExec->mNodeErr;
+
+	pNode->lstFds.emplace_back(fd, autoClose);
+	pNode->autoEnabled = true;
+
+	return *this;
+}
+
+FileExecuting &FileExecuting::sinkAdd(Transfering *pTrans, int fdSel)
+{
+	if (!pTrans)
+		return *this;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	int idx = mLstExec.size();
+	if (!idx)
+		return *this;
+	--idx;
+
+	FileExecuting *pExec = mLstExec[idx];
+	FeNode *pNode = fdSel == STDOUT_FILENO ? &pExec->mNodeOut : &pExec->mNodeErr;
+
+	pNode->lstTransfers.push_back(pTrans);
+	pNode->autoEnabled = true;
+
+	return *this;
+}
+
+/*
+ * Soft and hard limit of the last command.
+ * Example: RLIMIT_CPU, RLIMIT_AS, RLIMIT_NOFILE
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man2/setrlimit.2.html
+ */
+FileExecuting &FileExecuting::rlimitSet(int resource, rlim_t limit)
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	int idx = mLstExec.size();
+	if (!idx)
+		return *this;
+	--idx;
+
+	FileExecuting *pExec = mLstExec[idx];
+	FeRlimit rlim;
+
+	rlim.resource = resource;
+	rlim.limit = limit;
+
+	pExec->mRlimits.push_back(rlim);
+
+	return *this;
+}
+
+/*
+ * Captured data is owned by the FileExecuting() process.
+ * It can be taken over after the process has finished.
+ * The size hint is used for the first chunk
+ */
+FileExecuting &FileExecuting::sinkCapture(size_t sizeHint, int fdSel)
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	int idx = mLstExec.size();
+	if (!idx)
+		return *this;
+	--idx;
+
+	FileExecuting *pExec = mLstExec[idx];
+	FeNode *pNode = fdSel == STDOUT_FILENO ? &pExec->mNodeOut : &pExec->mNodeErr;
+	FeCapture *pCapture = fdSel == STDOUT_FILENO ? &mCaptureOut : &mCaptureErr;
+
+	pCapture->sizeHint = sizeHint;
+
+	pNode->pCapture = pCapture;
+	pNode->autoEnabled = true;
+
+	return *this;
+}
+
+FileExecuting &FileExecuting::errRedirect()
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxConfig);
+#endif
+	if (mConfigClosed)
+		return *this;
+
+	int idx = mLstExec.size();
+	if (!idx)
+		return *this;
+	--idx;
+
+	FileExecuting *pExec = mLstExec[idx];
+
+	pExec->mNodeErr.redirect = true;
+
+	return *this;
+}
+
+int FileExecuting::sigSend(int sig, ssize_t idx) const
+{
+	// internal
+
+	if (mIsInternal)
+	{
+		if (mpResult->idChild < 0)
+			return procErrLog(-2, "cannot send signal. Child PID not set");
+#if dHavePidFd
+		if (mFdPid >= 0)
+			return syscall(SYS_pidfd_send_signal, mFdPid, sig, NULL, 0);
+#endif
+		return kill(mpResult->idChild, sig);
+	}
+
+	// container - specific internal
+
+	if (idx >= (ssize_t)mLstExec.size())
+		return procErrLog(-3, "cannot send signal. Index out of bounds");
+
+	if (idx >= 0)
+		return mLstExec[idx]->sigSend(sig);
+
+	// container - all internals
+
+	if (!mLstExec.size())
+		return procErrLog(-4, "cannot send signal. Empty command list");
+
+	vector<FileExecuting *>::const_iterator iter;
+	int res;
+
+	idx = 0;
+	iter = mLstExec.begin();
+	for (; iter != mLstExec.end(); ++iter, ++idx)
+	{
+		res = (*iter)->sigSend(sig);
+		if (res < 0)
+			return procErrLog(-4, "error sending signal to process. Index %d, PID %d: %s",
+							idx, (*iter)->mpResult->idChild, strerror(errno));
+	}
+
+	return 0;
+}
+
+list<string> FileExecuting::captureTake(int fdSel)
+{
+	FeCapture *pCapture = fdSel == STDOUT_FILENO ? &mCaptureOut : &mCaptureErr;
+	list<string> chunks;
+
+	if (success() == Pending)
+	{
+		procWrnLog("could not take captured data. Process not finished");
+		return chunks;
+	}
+
+	chunks.swap(pCapture->chunks);
+	pCapture->len = 0;
+
+	return chunks;
+}
+
+string FileExecuting::captureStrTake(int fdSel)
+{
+	FeCapture *pCapture = fdSel == STDOUT_FILENO ? &mCaptureOut : &mCaptureErr;
+	size_t len = pCapture->len;
+	list<string> chunks = captureTake(fdSel);
+	list<string>::iterator iter;
+	string str;
+
+	if (chunks.size() == 1)
+		return std::move(chunks.front());
+
+	str.reserve(len);
+
+	iter = chunks.begin();
+	for (; iter != chunks.end(); ++iter)
+		str.append(*iter);
+
+	return str;
+}
+
+bool FileExecuting::boolRet(ssize_t idx, size_t offs, bool isAnd)
+{
+	{
+#if CONFIG_PROC_HAVE_DRIVERS
+		Guard lock(mMtxConfig);
+#endif
+		if (!mConfigClosed)
+			return false;
+	}
+
+	// container - specific internal
+
+	if (idx >= (ssize_t)mLstExec.size())
+		return false;
+
+	if (idx >= 0)
+	{
+		bool *pBool = &mResults[idx].childStopped;
+		pBool += offs;
+		return *pBool;
+	}
+
+	// container - all internals
+
+	bool checkRes;
+
+	for (size_t i = 0; i < mResults.size(); ++i)
+	{
+		checkRes = boolRet(i, offs, false);
+
+		if (isAnd xor checkRes)
+			return checkRes;
+	}
+
+	return isAnd;
+}
+
+int FileExecuting::intRet(ssize_t idx, size_t offs)
+{
+	{
+#if CONFIG_PROC_HAVE_DRIVERS
+		Guard lock(mMtxConfig);
+#endif
+		if (!mConfigClosed)
+			return false;
+	}
+
+	// container - specific internal
+
+	if (idx >= (ssize_t)mLstExec.size())
+		return procErrLog(-1, "index out of bounds");
+
+	if (idx >= 0)
+	{
+		int *pInt = &mResults[idx].idChild;
+		pInt += offs;
+		return *pInt;
+	}
+
+	// container - last internal
+
+	size_t i = mResults.size();
+
+	if (!i)
+		return procErrLog(-1, "empty result list");
+
+	return intRet(i - 1, offs);
+}
+
+/*
+ * Copy of the complete result of a command.
+ * idx = -1: Last command
+ */
+FeResult FileExecuting::result(ssize_t idx)
+{
+	FeResult res;
+
+	memset(&res, 0, sizeof(res));
+	res.idChild = -1;
+
+	{
+#if CONFIG_PROC_HAVE_DRIVERS
+		Guard lock(mMtxConfig);
+#endif
+		if (!mConfigClosed)
+			return res;
+	}
+
+	if (idx < 0)
+		idx = mResults.size() - 1;
+
+	if (idx < 0 || idx >= (ssize_t)mResults.size())
+		return res;
+
+	return mResults[idx];
+}
+
+/*
+ * Until now if the child is still running
+ */
+uint32_t FileExecuting::msWall(ssize_t idx)
+{
+	FeResult res = result(idx);
+
+	if (!res.msStart)
+		return 0;
+
+	if (!res.childTerminated)
+		return millis() - res.msStart;
+
+	return res.msEnd - res.msStart;
+}
+
+ssize_t FileExecuting::send(const void *pData, size_t lenReq)
+{
+	if (!mIsInternal && mLstExec.size())
+		return mLstExec.front()->send(pData, lenReq);
+
+	if (mNodeIn.autoEnabled)
+		return procErrLog(-1, "unable to send data. Auto sourcing");
+
+	if (!mNodeIn.manualEnabled)
+		return procErrLog(-1, "unable to send data. Source not enabled");
+
+	return intSend(pData, lenReq);
+}
+
+ssize_t FileExecuting::intSend(const void *pData, size_t lenReq)
+{
+	if (!pData || !lenReq)
+		return procErrLog(-1, "could not send data. Buffer not set");
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxWrite);
+#endif
+	if (!mSendReady)
+		return procErrLog(-1, "could not send data. Not ready");
+
+	int &fdWrite = mNodeIn.pipe.fdWrite;
+
+	if (fdWrite < 0)
+		return procErrLog(-1, "could not send data. File descriptor not set");
+
+	ssize_t res;
+	size_t bytesSent = 0;
+
+	// Pipe is non-blocking. Returns the number of bytes which fit
+	while (lenReq)
+	{
+		res = ::write(fdWrite, (const char *)pData, lenReq);
+		if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+
+		if (res < 0 && errno == EINTR)
+			continue;
+
+		if (res < 0)
+		{
+			fdClose(fdWrite);
+			return procErrLog(-1, "write() failed: %s", strerror(errno));
+		}
+
+		if (!res)
+			break;
+
+		pData = ((const uint8_t *)pData) + res;
+		lenReq -= res;
+
+		bytesSent += res;
+	}
+
+	mBytesSent += bytesSent;
+	bytesCount(&mNodeIn, bytesSent);
+
+	return bytesSent;
+}
+
+ssize_t FileExecuting::read(void *pBuf, size_t lenReq)
+{
+	return sinkRead(pBuf, lenReq);
+}
+
+ssize_t FileExecuting::sinkRead(void *pBuf, size_t lenReq, int fdSel)
+{
+	FeNode *pNode = fdSel == STDOUT_FILENO ? &mNodeOut : &mNodeErr;
+
+	if (!mIsInternal && mLstExec.size())
+		return mLstExec.back()->sinkRead(pBuf, lenReq, fdSel);
+
+	if (pNode->autoEnabled)
+		return procErrLog(-1, "unable to read data. Auto sinking");
+
+	if (!pNode->manualEnabled)
+		return procErrLog(-1, "unable to read data. Sink not enabled");
+
+	return intSinkRead(pBuf, lenReq, pNode);
+}
+
+ssize_t FileExecuting::intSinkRead(void *pBuf, size_t lenReq, FeNode *pNode)
+{
+	if (!pBuf || !lenReq)
+		return -1;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxRead);
+#endif
+	if (!pNode)
+		return procErrLog(-1, "unable to read data. Node not set");
+
+	if (!mReadReady)
+		return 0;
+
+	int &fdRead = pNode->pipe.fdRead;
+
+	if (fdRead < 0)
+		return -2;
+
+	ssize_t lenRead = 0;
+
+	lenRead = ::read(fdRead, (char *)pBuf, lenReq);
+
+	bool isErr = lenRead < 0;
+	bool wouldBlock = isErr && ((errno == EAGAIN) || (errno == EWOULDBLOCK));
+	bool isErrFinal = isErr && !wouldBlock;
+	bool isDone = !lenRead || (wouldBlock && mpResult->childTerminated) || isErrFinal;
+
+	if (isDone)
+		fdClose(fdRead);
+
+	if (isErrFinal)
+		return procErrLog(-3, "read() failed: %s", strerror(errno));
+
+	if (isDone)
+	{
+		procDbgLog("end-of-file");
+		return -4;
+	}
+
+	if (wouldBlock)
+		return 0;
+
+	//procDbgLog("received data. len: %d", lenRead);
+
+	mBytesRead += lenRead;
+	bytesCount(pNode, lenRead);
+
+	return lenRead;
+}
+
+void FileExecuting::pipeInit(FePairFd &pair)
+{
+	pair.fdRead = -1;
+	pair.fdWrite = -1;
+}
+
+void FileExecuting::pipeClose(FePairFd &pair, bool deInit)
+{
+	fdClose(pair.fdRead, deInit);
+	fdClose(pair.fdWrite, deInit);
+}
+
+void FileExecuting::pipeSizeApply(int fd)
+{
+	if (!mSizePipe || fd < 0)
+		return;
+#if defined(__linux__) && defined(F_SETPIPE_SZ)
+	int res;
+
+	res = fcntl(fd, F_SETPIPE_SZ, (int)mSizePipe);
+	if (res < 0)
+		procWrnLog("could not set pipe size: %s", strerror(errno));
+#endif
+}
+
+size_t FileExecuting::pipeSizeGet(int fd)
+{
+	if (fd < 0)
+		return cSizeIoMaxDefault;
+#if defined(__linux__) && defined(F_GETPIPE_SZ)
+	int res;
+
+	res = fcntl(fd, F_GETPIPE_SZ);
+	if (res > 0)
+		return res;
+#endif
+	return cSizeIoMaxDefault;
+}
+
+bool FileExecuting::fileNonBlockingSet(int fd)
+{
+	int opt = 1;
+#ifdef _WIN32
+	unsigned long nonBlockMode = 1;
+
+	opt = ioctlsocket(fd, FIONBIO, &nonBlockMode);
+	if (opt == SOCKET_ERROR)
+		return false;
+#else
+	opt = fcntl(fd, F_GETFL, 0);
+	if (opt == -1)
+		return false;
+
+	opt |= O_NONBLOCK;
+
+	opt = fcntl(fd, F_SETFL, opt);
+	if (opt == -1)
+		return false;
+#endif
+	return true;
+}
+
+void FileExecuting::fdClose(int &fd, bool deInit)
+{
+	if (fd < 0)
+		return;
+
+	close(fd);
+
+	if (!deInit)
+		return;
+
+	fd = -1;
+}
+
+void FileExecuting::processInfo(char *pBuf, char *pBufEnd)
+{
+	if (!mIsInternal)
+		containerInfo(pBuf, pBufEnd);
+	else
+		internalInfo(pBuf, pBufEnd);
+}
+
+void FileExecuting::containerInfo(char *pBuf, char *pBufEnd)
+{
+#if 0
+	dInfo("State\t\t\t%s\n", ProcStateString[mState]);
+#else
+	(void)pBuf;
+	(void)pBufEnd;
+#endif
+}
+
+void FileExecuting::internalInfo(char *pBuf, char *pBufEnd)
+{
+#if 1
+	//dInfo("State\t\t\t%s\n", ProcStateString[mState]);
+	dInfo("File\t\t\t%s [%d]\n", mCmdBase.c_str(), mpResult->idChild);
+#if 0
+	dInfo("Child\n");
+	dInfo("  State\t\t\t%s%s\n", mStrStateChild.c_str(),
+					mpResult->coreDumped ? " (core dumped)" : "");
+	dInfo("  Signal\t\t\t%d\n", mpResult->codeSig);
+	dInfo("  Return code\t\t%d\n", mpResult->codeRet);
+	dInfo("  Terminated\t\t%s\n", mpResult->childTerminated ? "Yes" : "No");
+#endif
+#if 0
+	dInfo("Done\t\t\t%d\n", mDone);
+	dInfo("Pipes\t\t\t%d, %d | %d, %d | %d, %d\n",
+			mNodeIn.pipe.fdRead,
+			mNodeIn.pipe.fdWrite,
+			mNodeOut.pipe.fdRead,
+			mNodeOut.pipe.fdWrite,
+			mNodeErr.pipe.fdRead,
+			mNodeErr.pipe.fdWrite);
+	dInfo("Auto\t\t\t%d, %d, %d\r\n",
+			mNodeIn.autoDone,
+			mNodeOut.autoDone,
+			mNodeErr.autoDone);
+#endif
+	dInfo("Bytes read\t\t%d\r\n", mBytesRead);
+	//dInfo("Bytes sent\t\t%d\n", mBytesSent);
+#endif
+}
+
+/* static functions */
+
+/*
+ * Runs in the child after vfork() or fork().
+ * Never returns
+ */
+void FileExecuting::childExec(int fdIn, int fdOut, int fdErr, int fdCgroupProcs,
+				const vector<FeRlimit> &rlimits, char **pArgs, char **pEnv)
+{
+	bool ok;
+	int res;
+
+	// Setup Pipes
+#if 1
+	res = dup2(fdErr, STDERR_FILENO);
+	if (res < 0)
+		_exit(EXIT_FAILURE); // only valid situation in every system to use _exit()!
+#endif
+	res = dup2(fdIn, STDIN_FILENO);
+	if (res < 0)
+	{
+		cerr << "could not duplicate fd (stdin): " << strerror(errno) << endl;
+		_exit(EXIT_FAILURE);
+	}
+
+	res = dup2(fdOut, STDOUT_FILENO);
+	if (res < 0)
+	{
+		cerr << "could not duplicate fd (stdout): " << strerror(errno) << endl;
+		_exit(EXIT_FAILURE);
+	}
+
+	// Writing 0 moves the calling process
+	if (fdCgroupProcs >= 0 && write(fdCgroupProcs, "0", 1) < 0)
+	{
+		cerr << "could not join cgroup: " << strerror(errno) << endl;
+		_exit(EXIT_FAILURE);
+	}
+
+	// Close all open files
+	ok = closefromInternal(3);
+	if (!ok)
+	{
+		cerr << "could close file descriptors: " << strerror(errno) << endl;
+		_exit(EXIT_FAILURE);
+	}
+
+	// After closing. RLIMIT_NOFILE would hide open files otherwise
+	for (size_t i = 0; i < rlimits.size(); ++i)
+	{
+		struct rlimit rl;
+
+		rl.rlim_cur = rlimits[i].limit;
+		rl.rlim_max = rlimits[i].limit;
+
+		res = setrlimit(rlimits[i].resource, &rl);
+		if (res < 0)
+		{
+			cerr << "could not set resource limit: " << strerror(errno) << endl;
+			_exit(EXIT_FAILURE);
+		}
+	}
+
+	// Execute
+	res = execvpe(pArgs[0], pArgs, pEnv);
+	if (res < 0)
+	{
+		cerr << "could not execute file '" << pArgs[0] << "': " << strerror(errno) << endl;
+		_exit(EXIT_FAILURE);
+	}
+
+	cerr << "reached invalid position" << endl;
+	_exit(EXIT_FAILURE);
+}
+
+uint32_t FileExecuting::tvToMs(const struct timeval &tv)
+{
+	return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/*
+ * A single system call if the kernel supports close_range().
+ * Otherwise every descriptor below the soft limit is closed
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man2/close_range.2.html
+ * - https://www.man7.org/linux/man-pages/man2/getrlimit.2.html
+ */
+bool FileExecuting::closefromInternal(int fdStart)
+{
+	struct rlimit rl;
+	rlim_t fd;
+	int res;
+#if defined(__linux__) && defined(SYS_close_range)
+	res = syscall(SYS_close_range, (unsigned int)fdStart, ~0U, 0);
+	if (!res)
+		return true;
+#endif
+	res = getrlimit(RLIMIT_NOFILE, &rl);
+	if (res)
+		return false;
+
+	fd = fdStart;
+	for (; fd < rl.rlim_cur; ++fd)
+		close(fd);
+
+	return true;
+}
+
+/*
+ * Forks the zygote. Must be called early. Ideally before
+ * creating threads and allocating large amounts of memory.
+ * Launching commands with FeSpawnZygote is then independent
+ * of the memory footprint of this process
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man2/socketpair.2.html
+ */
+bool FileExecuting::zygoteStart()
+{
+#if defined(__linux__)
+	static bool destructorRegistered = false;
+	pid_t idProc;
+	int fds[2];
+	int res;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxZygote);
+#endif
+	if (mFdZygote >= 0)
+		return true;
+
+	res = socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds);
+	if (res < 0)
+		return errLog(false, "could not create socket pair: %s", strerror(errno));
+
+	idProc = fork();
+	if (idProc < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+
+		return errLog(false, "could not fork zygote: %s", strerror(errno));
+	}
+
+	if (!idProc)
+	{
+		close(fds[0]);
+		zygoteMain(fds[1]);
+		_exit(EXIT_SUCCESS);
+	}
+
+	close(fds[1]);
+
+	mFdZygote = fds[0];
+	mIdZygote = idProc;
+
+	if (!destructorRegistered)
+	{
+		Processing::globalDestructorRegister(zygoteStop);
+		destructorRegistered = true;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+void FileExecuting::zygoteStop()
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxZygote);
+#endif
+	zygoteLost();
+}
 
-	// container - last internal
+/*
+ * Must be called with the zygote mutex locked
+ */
+void FileExecuting::zygoteLost()
+{
+	if (mFdZygote >= 0)
+		close(mFdZygote);
 
-	size_t i = mResults.size();
+	// The zygote terminates on end-of-file
+	if (mIdZygote > 0)
+		waitpid(mIdZygote, NULL, 0);
 
-	if (!i)
-		return procErrLog(-1, "empty result list");
+	mFdZygote = -1;
+	mIdZygote = -1;
 
-	return intRet(i - 1, offs);
+	// No more reports
+	mZygoteSpawns.clear();
+	mZygoteReqsAbandoned.clear();
+	mZygoteIdsAbandoned.clear();
 }
 
-ssize_t FileExecuting::send(const void *pData, size_t lenReq)
+/*
+ * Must be called with the zygote mutex locked.
+ * The response to a spawn request always arrives before the
+ * exit of the child. An exit reported before belongs to a
+ * previous child with the same PID.
+ * Children of requests which timed out are killed
+ *
+ * Returns
+ * - > 0: Message received
+ * - = 0: No message within the timeout
+ * - < 0: Zygote lost
+ */
+ssize_t FileExecuting::zygoteMsgRecv(FeZygoteMsg &msg, int msTimeout)
 {
-	if (!mIsInternal && mLstExec.size())
-		return mLstExec.front()->send(pData, lenReq);
+#if defined(__linux__)
+	struct pollfd pfd;
+	ssize_t res;
 
-	if (mNodeIn.autoEnabled)
-		return procErrLog(-1, "unable to send data. Auto sourcing");
+	if (mFdZygote < 0)
+		return -1;
 
-	if (!mNodeIn.manualEnabled)
-		return procErrLog(-1, "unable to send data. Source not enabled");
+	pfd.fd = mFdZygote;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
 
-	return intSend(pData, lenReq);
-}
+	do
+		res = poll(&pfd, 1, msTimeout);
+	while (res < 0 && errno == EINTR);
 
-ssize_t FileExecuting::intSend(const void *pData, size_t lenReq)
-{
-	if (!pData || !lenReq)
-		return procErrLog(-1, "could not send data. Buffer not set");
+	if (res < 0)
+		return -1;
 
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxWrite);
-#endif
-	if (!mSendReady)
-		return procErrLog(-1, "could not send data. Not ready");
+	if (!res)
+		return 0;
 
-	int &fdWrite = mNodeIn.pipe.fdWrite;
+	do
+		res = recv(mFdZygote, &msg, sizeof(msg), MSG_DONTWAIT);
+	while (res < 0 && errno == EINTR);
 
-	if (fdWrite < 0)
-		return procErrLog(-1, "could not send data. File descriptor not set");
+	if (res < 0 && errno == EAGAIN)
+		return 0;
 
-	ssize_t res;
-	size_t lenBkup = lenReq;
-	size_t bytesSent = 0;
+	if (res != (ssize_t)sizeof(msg))
+		return -1;
 
-	while (lenReq)
+	if (msg.type == FeZygoteSpawned)
 	{
-		res = ::write(fdWrite, (const char *)pData, lenReq);
-		if (res < 0)
+		mZygoteExits.erase(msg.idProc);
+
+		if (!mZygoteReqsAbandoned.erase(msg.idReq))
 		{
-			fdClose(fdWrite);
-			return procErrLog(-1, "write() failed: %s", strerror(errno));
+			mZygoteSpawns[msg.idReq] = msg;
+			return 1;
 		}
 
-		if (!res)
-			break;
-
-		pData = ((const uint8_t *)pData) + res;
-		lenReq -= res;
+		if (msg.idProc > 0)
+		{
+			kill(msg.idProc, SIGKILL);
+			mZygoteIdsAbandoned.insert(msg.idProc);
+		}
 
-		bytesSent += res;
+		return 1;
 	}
 
-	if (bytesSent != lenBkup)
-		procWrnLog("not all data has been sent");
+	if (msg.type == FeZygoteExited)
+	{
+		if (mZygoteIdsAbandoned.erase(msg.idProc))
+			return 1;
 
-	mBytesSent += bytesSent;
+		FeZygoteExit &exit = mZygoteExits[msg.idProc];
 
-	return bytesSent;
-}
+		exit.status = msg.status;
+		exit.usage = msg.usage;
+	}
 
-ssize_t FileExecuting::read(void *pBuf, size_t lenReq)
-{
-	return sinkRead(pBuf, lenReq);
+	return 1;
+#else
+	(void)msg;
+	(void)msTimeout;
+	return -1;
+#endif
 }
 
-ssize_t FileExecuting::sinkRead(void *pBuf, size_t lenReq, int fdSel)
+void FileExecuting::zygoteMsgsDrain()
 {
-	FeNode *pNode = fdSel == STDOUT_FILENO ? &mNodeOut : &mNodeErr;
-
-	if (!mIsInternal && mLstExec.size())
-		return mLstExec.back()->sinkRead(pBuf, lenReq, fdSel);
-
-	if (pNode->autoEnabled)
-		return procErrLog(-1, "unable to read data. Auto sinking");
+	FeZygoteMsg msg;
+	ssize_t res;
 
-	if (!pNode->manualEnabled)
-		return procErrLog(-1, "unable to read data. Sink not enabled");
+	while (1)
+	{
+		res = zygoteMsgRecv(msg, 0);
+		if (!res)
+			return;
 
-	return intSinkRead(pBuf, lenReq, pNode);
+		if (res < 0)
+		{
+			errLog(-1, "zygote lost");
+			zygoteLost();
+			return;
+		}
+	}
 }
 
-ssize_t FileExecuting::intSinkRead(void *pBuf, size_t lenReq, FeNode *pNode)
+/*
+ * The zygote only forks and reaps children.
+ * It terminates when the parent closes the socket
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man2/signalfd.2.html
+ */
+void FileExecuting::zygoteMain(int fd)
 {
-	if (!pBuf || !lenReq)
-		return -1;
+#if defined(__linux__)
+	char bufCtrl[CMSG_SPACE(cNumZygoteFdsMax * sizeof(int))];
+	vector<char> bufReq(cSizeZygoteMsgMax);
+	struct signalfd_siginfo infoSig;
+	struct pollfd pfds[2];
+	struct cmsghdr *pCmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	int fds[cNumZygoteFdsMax];
+	size_t numFds;
+	sigset_t mask;
+	int fdSig;
+	ssize_t res;
 
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mMtxRead);
-#endif
-	if (!pNode)
-		return procErrLog(-1, "unable to read data. Node not set");
+	// Release everything inherited from the parent. Except the socket
+	res = dup2(fd, 3);
+	if (res < 0)
+		return;
 
-	if (!mReadReady)
-		return 0;
+	fd = 3;
+	closefromInternal(4);
 
-	int &fdRead = pNode->pipe.fdRead;
+	// Interrupts are meant for the parent
+	signal(SIGINT, SIG_IGN);
+	signal(SIGTERM, SIG_IGN);
+	signal(SIGHUP, SIG_IGN);
 
-	if (fdRead < 0)
-		return -2;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
 
-	ssize_t lenRead = 0;
+	fdSig = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fdSig < 0)
+		return;
 
-	lenRead = ::read(fdRead, (char *)pBuf, lenReq);
+	pfds[0].fd = fd;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = fdSig;
+	pfds[1].events = POLLIN;
 
-	bool isErr = lenRead < 0;
-	bool wouldBlock = isErr && ((errno == EAGAIN) || (errno == EWOULDBLOCK));
-	bool isErrFinal = isErr && !wouldBlock;
-	bool isDone = !lenRead || (wouldBlock && mpResult->childTerminated) || isErrFinal;
+	while (1)
+	{
+		pfds[0].revents = 0;
+		pfds[1].revents = 0;
 
-	if (isDone)
-		fdClose(fdRead);
+		res = poll(pfds, 2, -1);
+		if (res < 0 && errno == EINTR)
+			continue;
 
-	if (isErrFinal)
-		return procErrLog(-3, "read() failed: %s", strerror(errno));
+		if (res < 0)
+			break;
 
-	if (isDone)
-	{
-		procDbgLog("end-of-file");
-		return -4;
-	}
+		if (pfds[1].revents & POLLIN)
+		{
+			while (::read(fdSig, &infoSig, sizeof(infoSig)) > 0)
+				;
 
-	if (wouldBlock)
-		return 0;
+			zygoteChildrenReap(fd);
+		}
 
-	//procDbgLog("received data. len: %d", lenRead);
+		if (!pfds[0].revents)
+			continue;
 
-	mBytesRead += lenRead;
+		iov.iov_base = bufReq.data();
+		iov.iov_len = bufReq.size();
 
-	return lenRead;
-}
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = bufCtrl;
+		msg.msg_controllen = sizeof(bufCtrl);
 
-void FileExecuting::pipeInit(FePairFd &pair)
-{
-	pair.fdRead = -1;
-	pair.fdWrite = -1;
-}
+		res = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+		if (res < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
 
-void FileExecuting::pipeClose(FePairFd &pair, bool deInit)
-{
-	fdClose(pair.fdRead, deInit);
-	fdClose(pair.fdWrite, deInit);
-}
+		if (res <= 0)
+			break; // Parent gone
 
-bool FileExecuting::fileNonBlockingSet(int fd)
-{
-	int opt = 1;
-#ifdef _WIN32
-	unsigned long nonBlockMode = 1;
+		numFds = 0;
 
-	opt = ioctlsocket(fd, FIONBIO, &nonBlockMode);
-	if (opt == SOCKET_ERROR)
-		return false;
-#else
-	opt = fcntl(fd, F_GETFL, 0);
-	if (opt == -1)
-		return false;
+		pCmsg = CMSG_FIRSTHDR(&msg);
+		if (pCmsg && pCmsg->cmsg_level == SOL_SOCKET && pCmsg->cmsg_type == SCM_RIGHTS)
+		{
+			numFds = (pCmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			numFds = PMIN(numFds, cNumZygoteFdsMax);
+			memcpy(fds, CMSG_DATA(pCmsg), numFds * sizeof(int));
+		}
 
-	opt |= O_NONBLOCK;
+		zygoteRequestHandle(fd, bufReq.data(), res, fds, numFds);
 
-	opt = fcntl(fd, F_SETFL, opt);
-	if (opt == -1)
-		return false;
+		for (size_t i = 0; i < numFds; ++i)
+			close(fds[i]);
+	}
+
+	close(fdSig);
+	close(fd);
+#else
+	(void)fd;
 #endif
-	return true;
 }
 
-void FileExecuting::fdClose(int &fd, bool deInit)
+/*
+ * Runs in the zygote
+ */
+void FileExecuting::zygoteRequestHandle(int fd, const char *pBuf, size_t len,
+				const int *pFds, size_t numFds)
 {
-	if (fd < 0)
+#if defined(__linux__)
+	vector<FeRlimit> rlimits;
+	vector<char *> args, env;
+	FeZygoteMsg msgRsp;
+	FeZygoteReq req;
+	const char *pStr, *pEnd;
+	sigset_t mask;
+	pid_t idProc;
+	size_t lenRlimits;
+
+	memset(&msgRsp, 0, sizeof(msgRsp));
+	msgRsp.type = FeZygoteSpawned;
+	msgRsp.idProc = -1;
+
+	memset(&req, 0, sizeof(req));
+	memcpy(&req, pBuf, PMIN(len, sizeof(req)));
+	msgRsp.idReq = req.idReq;
+	lenRlimits = req.numRlimits * sizeof(FeRlimit);
+
+	if (len < sizeof(req) || len != sizeof(req) + lenRlimits + req.lenStrs ||
+			numFds != req.numFds || numFds < 3 || !req.numArgs)
+	{
+		msgRsp.err = EINVAL;
+		::send(fd, &msgRsp, sizeof(msgRsp), MSG_NOSIGNAL);
 		return;
+	}
 
-	close(fd);
+	idProc = fork();
+	if (idProc)
+	{
+		msgRsp.idProc = idProc;
+		msgRsp.err = idProc < 0 ? errno : 0;
 
-	if (!deInit)
+		::send(fd, &msgRsp, sizeof(msgRsp), MSG_NOSIGNAL);
 		return;
+	}
 
-	fd = -1;
-}
+	// Child
 
-/*
- * Literature
- * - https://www.man7.org/linux/man-pages/man2/getrlimit.2.html
- */
-bool FileExecuting::closefromInternal(int fdStart)
-{
-	struct rlimit rl;
-	rlim_t fd;
-	int res;
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGHUP, SIG_DFL);
 
-	res = getrlimit(RLIMIT_NOFILE, &rl);
-	if (res)
-		return false;
+	sigemptyset(&mask);
+	sigprocmask(SIG_SETMASK, &mask, NULL);
 
-	fd = fdStart;
-	for (; fd < rl.rlim_max; ++fd)
-		close(fd);
+	rlimits.resize(req.numRlimits);
+	if (lenRlimits)
+		memcpy(rlimits.data(), pBuf + sizeof(req), lenRlimits);
 
-	return true;
-}
+	pStr = pBuf + sizeof(req) + lenRlimits;
+	pEnd = pBuf + len;
 
-void FileExecuting::processInfo(char *pBuf, char *pBufEnd)
-{
-	if (!mIsInternal)
-		containerInfo(pBuf, pBufEnd);
-	else
-		internalInfo(pBuf, pBufEnd);
-}
+	for (uint32_t i = 0; i < req.numArgs + req.numEnv && pStr < pEnd; ++i)
+	{
+		if (i < req.numArgs)
+			args.push_back((char *)pStr);
+		else
+			env.push_back((char *)pStr);
 
-void FileExecuting::containerInfo(char *pBuf, char *pBufEnd)
-{
-#if 0
-	dInfo("State\t\t\t%s\n", ProcStateString[mState]);
+		pStr += strlen(pStr) + 1;
+	}
+
+	args.push_back(NULL);
+	env.push_back(NULL);
+
+	childExec(pFds[0], pFds[1], pFds[2], numFds > 3 ? pFds[3] : -1,
+				rlimits, args.data(), env.data());
 #else
+	(void)fd;
 	(void)pBuf;
-	(void)pBufEnd;
+	(void)len;
+	(void)pFds;
+	(void)numFds;
 #endif
 }
 
-void FileExecuting::internalInfo(char *pBuf, char *pBufEnd)
+/*
+ * Runs in the zygote
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man2/wait4.2.html
+ */
+void FileExecuting::zygoteChildrenReap(int fd)
 {
-#if 1
-	//dInfo("State\t\t\t%s\n", ProcStateString[mState]);
-	dInfo("File\t\t\t%s [%d]\n", mCmdBase.c_str(), mpResult->idChild);
-#if 0
-	dInfo("Child\n");
-	dInfo("  State\t\t\t%s%s\n", mStrStateChild.c_str(),
-					mpResult->coreDumped ? " (core dumped)" : "");
-	dInfo("  Signal\t\t\t%d\n", mpResult->codeSig);
-	dInfo("  Return code\t\t%d\n", mpResult->codeRet);
-	dInfo("  Terminated\t\t%s\n", mpResult->childTerminated ? "Yes" : "No");
-#endif
-#if 0
-	dInfo("Done\t\t\t%d\n", mDone);
-	dInfo("Pipes\t\t\t%d, %d | %d, %d | %d, %d\n",
-			mNodeIn.pipe.fdRead,
-			mNodeIn.pipe.fdWrite,
-			mNodeOut.pipe.fdRead,
-			mNodeOut.pipe.fdWrite,
-			mNodeErr.pipe.fdRead,
-			mNodeErr.pipe.fdWrite);
-	dInfo("Auto\t\t\t%d, %d, %d\r\n",
-			mNodeIn.autoDone,
-			mNodeOut.autoDone,
-			mNodeErr.autoDone);
-#endif
-	dInfo("Bytes read\t\t%d\r\n", mBytesRead);
-	//dInfo("Bytes sent\t\t%d\n", mBytesSent);
-#endif
-}
+	FeZygoteMsg msg;
+	pid_t idProc;
+	int status;
 
-/* static functions */
+	while (1)
+	{
+		memset(&msg, 0, sizeof(msg));
+
+		idProc = wait4(-1, &status, WNOHANG, &msg.usage);
+		if (idProc <= 0)
+			return;
+
+		msg.type = FeZygoteExited;
+		msg.idProc = idProc;
+		msg.status = status;
+
+		::send(fd, &msg, sizeof(msg), MSG_NOSIGNAL);
+	}
+}
 
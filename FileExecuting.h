@@ -30,16 +30,30 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <map>
+#include <set>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <unistd.h>
 #include <signal.h>
+#include <sys/resource.h>
 
 #include "Transfering.h"
 
 #define dTimeoutExecDefault	5000
+#define dMsKillDelayDefault	2000
 
 typedef std::vector<const char *> VecConstChar;
 typedef VecConstChar fec; // FileExecuting() Command
 
+enum FeSpawnMode
+{
+	FeSpawnFork = 0,	// vfork() + exec()
+	FeSpawnPosix,		// posix_spawn(). Falls back to vfork() if not supported
+	FeSpawnZygote,		// Requested from zygote. Falls back to vfork() if not running
+};
+
 struct FePairFd
 {
 	int fdRead;
@@ -83,6 +97,33 @@ struct FeFileDescSetting
 	bool autoClose;
 };
 
+typedef std::shared_ptr<const std::vector<char> > FeChunkPtr;
+
+struct FeChunkRef
+{
+	FeChunkPtr pChunk; // Shared by all sinks lagging behind
+	size_t offs;
+};
+
+// Sink which may not accept all data at once
+struct FeSinkQueue
+{
+	int fd;
+	Transfering *pTrans;
+	bool tee; // Pipe. Filled by the kernel using tee()
+	bool failed;
+	size_t lenTee; // Current read
+	std::deque<FeChunkRef> chunks;
+	size_t lenQueued;
+};
+
+struct FeCapture
+{
+	std::list<std::string> chunks; // Never reallocated once created
+	size_t sizeHint;
+	size_t len;
+};
+
 struct FeNode
 {
 	FePairFd pipe;
@@ -90,10 +131,27 @@ struct FeNode
 	std::list<std::string *> lstStrings;
 	std::list<FeFileDescSetting> lstFds;
 	std::list<Transfering *> lstTransfers;
+	FeCapture *pCapture; // Owned by container
+	std::list<FeSinkQueue> lstQueues; // fd and Transfering sinks
+	bool queuesCreated;
+	bool eof; // Pipe drained. Waiting for queues
 	bool manualEnabled;
 	bool autoEnabled;
 	bool autoDone;
 	bool redirect;
+	bool linked; // Pipe shared with adjacent command. Not relayed by parent
+	bool direct; // File used by child directly. No pipe
+	bool kernelIo; // Data moved using splice() and tee()
+	std::vector<char> bufIo; // Grows with the amount of data per read
+	size_t sizeIoMax; // Capacity of the pipe
+	size_t offsIoPending;
+	size_t lenIoPending;
+};
+
+struct FeRlimit
+{
+	int resource;
+	rlim_t limit;
 };
 
 struct FeResult
@@ -105,6 +163,47 @@ struct FeResult
 	int idChild;
 	int codeSig;
 	int codeRet;
+	struct rusage usage; // Resources used by the child. Valid after termination
+	uint32_t msStart;
+	uint32_t msEnd;
+	uint64_t bytesIn; // Relayed by this process. Not counted for linked pipes
+	uint64_t bytesOut;
+	uint64_t bytesErr;
+	uint64_t bytesDropped; // Not accepted by sinks until the timeout
+};
+
+enum FeZygoteMsgType
+{
+	FeZygoteSpawned = 0,
+	FeZygoteExited,
+};
+
+// Sent by the parent. Followed by rlimits and strings
+struct FeZygoteReq
+{
+	uint32_t idReq;
+	uint32_t numArgs;
+	uint32_t numEnv;
+	uint32_t numRlimits;
+	uint32_t numFds;
+	uint32_t lenStrs;
+};
+
+// Sent by the zygote
+struct FeZygoteMsg
+{
+	int32_t type;
+	int32_t idProc;
+	int32_t err; // Spawned
+	uint32_t idReq; // Spawned
+	int32_t status; // Exited. As returned by wait4()
+	struct rusage usage; // Exited
+};
+
+struct FeZygoteExit
+{
+	int status;
+	struct rusage usage;
 };
 
 // 1. https://man7.org/linux/man-pages/man2/pipe.2.html
@@ -121,9 +220,16 @@ public:
 		return new dNoThrow FileExecuting;
 	}
 
+	static bool zygoteStart();
+	static void zygoteStop();
+
 	// routing & change container
 
-	FileExecuting &msTimeoutSet(uint32_t msTimeout);
+	FileExecuting &msTimeoutSet(uint32_t msTimeout, uint32_t msKillDelay = dMsKillDelayDefault);
+	FileExecuting &cgroupSet(const std::string &dirParent,
+				uint64_t sizeMemMax = 0, uint32_t cpuPercentMax = 0);
+	FileExecuting &pipeSizeSet(size_t sizePipe);
+	FileExecuting &spawnModeSet(FeSpawnMode mode);
 	FileExecuting &sourceEnable();
 	FileExecuting &sourceSet(const char *pSrc, size_t len = 0, bool autoFree = false);
 	FileExecuting &sourceSet(const std::string *pStr);
@@ -152,15 +258,23 @@ public:
 	FileExecuting &sinkAdd(std::string *pStr, int fdSel = STDOUT_FILENO);
 	FileExecuting &sinkAdd(int fd, bool autoClose = false, int fdSel = STDOUT_FILENO);
 	FileExecuting &sinkAdd(Transfering *pTrans, int fdSel = STDOUT_FILENO);
+	FileExecuting &sinkCapture(size_t sizeHint = 0, int fdSel = STDOUT_FILENO);
 	FileExecuting &errRedirect();
+	FileExecuting &rlimitSet(int resource, rlim_t limit);
 
 	// getters & child control
 
 	size_t numCommands() const
 	{ return mLstExec.size(); }
 
+	bool timeoutReached() const
+	{ return mTimeoutReached; }
+
 	int sigSend(int sig, ssize_t idx = -1) const;
 
+	std::list<std::string> captureTake(int fdSel = STDOUT_FILENO);
+	std::string captureStrTake(int fdSel = STDOUT_FILENO);
+
 	bool childStopped(ssize_t idx = -1, bool isAnd = false)
 	{ return boolRet(idx, 0, isAnd); }
 	bool childTerminated(ssize_t idx = -1, bool isAnd = true)
@@ -177,6 +291,34 @@ public:
 	int codeRet(ssize_t idx = -1)
 	{ return intRet(idx, 2); }
 
+	FeResult result(ssize_t idx = -1);
+
+	// resource usage
+
+	uint32_t msWall(ssize_t idx = -1);
+	uint32_t msCpuUser(ssize_t idx = -1)
+	{ return tvToMs(result(idx).usage.ru_utime); }
+	uint32_t msCpuSys(ssize_t idx = -1)
+	{ return tvToMs(result(idx).usage.ru_stime); }
+	long sizeRssMax(ssize_t idx = -1) // kB
+	{ return result(idx).usage.ru_maxrss; }
+	long numBlocksIn(ssize_t idx = -1)
+	{ return result(idx).usage.ru_inblock; }
+	long numBlocksOut(ssize_t idx = -1)
+	{ return result(idx).usage.ru_oublock; }
+	long numCtxSwVol(ssize_t idx = -1)
+	{ return result(idx).usage.ru_nvcsw; }
+	long numCtxSwInvol(ssize_t idx = -1)
+	{ return result(idx).usage.ru_nivcsw; }
+	uint64_t bytesIn(ssize_t idx = -1)
+	{ return result(idx).bytesIn; }
+	uint64_t bytesOut(ssize_t idx = -1)
+	{ return result(idx).bytesOut; }
+	uint64_t bytesErr(ssize_t idx = -1)
+	{ return result(idx).bytesErr; }
+	uint64_t bytesDropped(ssize_t idx = -1)
+	{ return result(idx).bytesDropped; }
+
 	// send / read
 
 	ssize_t send(const void *pData, size_t lenReq);
@@ -210,14 +352,52 @@ private:
 	void containerInfo(char *pBuf, char *pBufEnd);
 	void internalInfo(char *pBuf, char *pBufEnd);
 
+	void pipelineLink();
+	void timeoutCheck();
+	void sigSendRunning(int sig);
+	bool cgroupCreate();
+	void cgroupRemove();
+	bool fileWrite(const std::string &path, const std::string &str);
 	bool sinksReady(FeNode *pNode) const;
+	void childrenExitCheck();
+	void pidFdOpen();
+	bool childStateCheckDue();
 	Success childStateRecord();
+	Success childStateGet(int &code, int &status);
+	void bytesCount(const FeNode *pNode, size_t len);
+	Success zygoteSpawn();
+	Success zygoteRspGet();
+	void zygoteReqAbandon();
+	bool zygoteReqPending();
+	Success zygoteStateGet(int &code, int &status);
+	void zygoteChildRelease();
 	void autoSource(FeNode *pNode);
+	ssize_t autoSourceRead(FeNode *pNode, char *pBuf, size_t lenReq);
 	void autoSourceDone();
+	void autoSourceKernel(FeNode *pNode);
 	void autoSink(FeNode *pNode);
-
-	char **vecConstCharToCharList(const VecConstChar &lst);
-	void ptrListFree(int cnt, char ** &lst);
+	void autoSinkDone(FeNode *pNode);
+	void autoSinkKernel(FeNode *pNode);
+	ssize_t sinkKernelMove(FeNode *pNode, size_t lenMax);
+	ssize_t kernelIoLeave(FeNode *pNode, size_t len, const std::vector<size_t> &lensTee);
+	void captureAppend(FeCapture *pCapture, const char *pData, size_t len);
+	bool nodeHasSinksExtra(const FeNode *pNode) const;
+	void nodeDirectSet(FeNode *pNode, bool isSource);
+	void nodeKernelIoCheck(FeNode *pNode, bool isSource);
+	void sinkQueuesCreate(FeNode *pNode);
+	void sinkQueuesFlush(FeNode *pNode);
+	bool sinkQueuesEmpty(const FeNode *pNode) const;
+	size_t sinkQueuesLen(const FeNode *pNode) const;
+	bool sinkQueuesFull(const FeNode *pNode) const;
+	size_t sinkQueuesTee(FeNode *pNode, size_t lenMax);
+	void sinkQueuesDeliver(FeNode *pNode, const char *pBuf, size_t len);
+	ssize_t sinkQueueWrite(FeSinkQueue *pQueue, const char *pData, size_t len);
+	void bufIoPrepare(FeNode *pNode);
+	void bufIoAdapt(FeNode *pNode, size_t lenDone);
+
+	bool argsArenaCreate();
+	void argsArenaFree();
+	Success childSpawn();
 
 	FileExecuting &intCmdAdd(const std::string &cmd, const VecConstChar &argv);
 	bool boolRet(ssize_t idx, size_t offs, bool isAnd = false);
@@ -228,9 +408,10 @@ private:
 
 	void pipeInit(FePairFd &pair);
 	void pipeClose(FePairFd &pair, bool deInit = true);
+	void pipeSizeApply(int fd);
+	size_t pipeSizeGet(int fd);
 	bool fileNonBlockingSet(int fd);
 	void fdClose(int &fd, bool deInit = true);
-	bool closefromInternal(int fdStart);
 
 	/* member variables */
 
@@ -240,15 +421,27 @@ private:
 
 	// container
 
-#if 0 // TODO: Implement
 	uint32_t mMsStart;
-#endif
 	uint32_t mMsTimeout;
+	uint32_t mMsKillDelay;
+	uint32_t mMsSigTerm;
+	bool mSigTermSent;
+	bool mSigKillSent;
+	bool mTimeoutReached;
+	std::string mDirCgroupParent;
+	std::string mDirCgroup;
+	uint64_t mSizeMemMax;
+	uint32_t mCpuPercentMax;
+	size_t mSizePipe;
+	FeSpawnMode mModeSpawn;
 	std::vector<FileExecuting *> mLstExec;
 	std::vector<FeResult> mResults;
+	FeCapture mCaptureOut;
+	FeCapture mCaptureErr;
 	FeNode mNodeIn;
 	bool mInternalsStarted;
 	bool mConfigClosed;
+	int mFdEpoll; // Readiness set of pidfds of all internals
 #if CONFIG_PROC_HAVE_DRIVERS
 	std::mutex mMtxConfig;
 #endif
@@ -257,11 +450,24 @@ private:
 	std::string mCmd;
 	std::string mCmdBase;
 	bool mUserEnv;
+	char *mpArena; // Holds arguments and environment
 	char **mpArgs;
 	char **mpEnv;
 	std::string mStrStateChild;
 	FeResult mResult;
 	FeResult *mpResult;
+	int mFdPid;
+	int mFdCgroupProcs; // Owned by container
+	const bool *mpTimeoutReached; // Owned by container
+	bool mSpawnedByZygote;
+	uint32_t mIdZygoteReq;
+	uint32_t mMsZygoteReq;
+	bool mZygoteReqOpen; // Response not consumed yet
+	bool mZygoteReqAbandoned;
+	std::vector<FeRlimit> mRlimits;
+	bool mFdPidWatched;
+	bool mChildExited;
+	uint32_t mMsStateCheck;
 	uint32_t mBytesRead;
 	uint32_t mBytesSent;
 #if CONFIG_PROC_HAVE_DRIVERS
@@ -275,8 +481,29 @@ private:
 	bool mDoneAck;
 
 	/* static functions */
+	static void childExec(int fdIn, int fdOut, int fdErr, int fdCgroupProcs,
+				const std::vector<FeRlimit> &rlimits, char **pArgs, char **pEnv);
+	static bool closefromInternal(int fdStart);
+	static uint32_t tvToMs(const struct timeval &tv);
+	static void zygoteMain(int fd);
+	static void zygoteRequestHandle(int fd, const char *pBuf, size_t len,
+				const int *pFds, size_t numFds);
+	static void zygoteChildrenReap(int fd);
+	static ssize_t zygoteMsgRecv(FeZygoteMsg &msg, int msTimeout);
+	static void zygoteMsgsDrain();
+	static void zygoteLost();
 
 	/* static variables */
+	static int mFdZygote;
+	static int mIdZygote;
+	static std::map<int, FeZygoteExit> mZygoteExits;
+	static std::map<uint32_t, FeZygoteMsg> mZygoteSpawns; // Key: ID of request
+	static std::set<uint32_t> mZygoteReqsAbandoned; // Timed out
+	static std::set<int> mZygoteIdsAbandoned; // Exit not waited for anymore
+	static uint32_t mIdZygoteReqNext;
+#if CONFIG_PROC_HAVE_DRIVERS
+	static std::mutex mMtxZygote;
+#endif
 
 	/* constants */
 
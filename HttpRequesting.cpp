@@ -57,9 +57,6 @@ using namespace std;
 
 //#define ENABLE_CURL_SHARE
 
-mutex HttpRequesting::mtxCurlMulti;
-CURLM *HttpRequesting::pCurlMulti = NULL;
-
 mutex HttpRequesting::sessionMtx;
 list<HttpSession> HttpRequesting::sessions;
 
@@ -388,18 +385,21 @@ Success HttpRequesting::process()
 		break;
 	case StReqStart:
 
-		multiProcess();
+		CurlMultiplexing::transfersProcess();
 
 		mState = StReqDoneWait;
 
 		break;
 	case StReqDoneWait:
 
-		multiProcess();
+		CurlMultiplexing::transfersProcess();
 
-		if (mDoneCurl == Pending)
+		if (mDoneCurl.load(memory_order_acquire) == Pending)
 			break;
 
+		easyHandleCurlUnbind();
+		easyHandleCurlRelease();
+
 		if (mCurlRes != CURLE_OK)
 			return procErrLog(-1, "curl performing failed: %s (%d)",
 						curl_easy_strerror(mCurlRes), mCurlRes);
@@ -449,19 +449,10 @@ Success HttpRequesting::shutdown()
  */
 Success HttpRequesting::easyHandleCurlBind()
 {
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mtxCurlMulti);
-#endif
-	if (!pCurlMulti)
-		pCurlMulti = multiHandleCurlInit();
-
-	if (!pCurlMulti)
-		return procErrLog(-1, "curl multi handle not set");
-
-	CURLMcode code;
+	Success success;
 
-	code = curl_multi_add_handle(pCurlMulti, mpCurl);
-	if (code != CURLM_OK)
+	success = CurlMultiplexing::easyAdd(mpCurl, curlDone, this);
+	if (success != Positive)
 		return procErrLog(-1, "could not bind curl easy handle");
 
 	mCurlBound = true;
@@ -469,40 +460,34 @@ Success HttpRequesting::easyHandleCurlBind()
 	return Positive;
 }
 
-CURLM *HttpRequesting::multiHandleCurlInit()
+void HttpRequesting::easyHandleCurlUnbind()
 {
-	CURLM *pMulti;
-
-	Processing::globalDestructorRegister(curlMultiDeInit);
+	if (!mCurlBound)
+		return;
 
-	pMulti = curl_multi_init();
-	if (!pMulti)
-		return NULL;
-#if 0
-	curl_multi_setopt(pMulti, CURLMOPT_MAX_HOST_CONNECTIONS, 5L);
-	curl_multi_setopt(pMulti, CURLMOPT_MAX_TOTAL_CONNECTIONS, 10L);
-#endif
-	dbgLog("global init curl multi done");
+	CurlMultiplexing::easyRemove(mpCurl);
 
-	return pMulti;
+	mCurlBound = false;
+	//procDbgLog("easy handle curl unbound");
 }
 
-void HttpRequesting::easyHandleCurlUnbind()
+/*
+ * Done by the client. The callback may run on
+ * the thread of CurlMultiplexing()
+ */
+void HttpRequesting::easyHandleCurlRelease()
 {
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mtxCurlMulti);
-#endif
-	if (!mCurlBound)
+	if (!mpCurl)
 		return;
 
-	CURLMcode code;
-
-	code = curl_multi_remove_handle(pCurlMulti, mpCurl);
-	if (code != CURLM_OK)
-		procWrnLog("could not unbind curl easy handle");
+	curlListFree(&mpListHeader);
+	curlListFree(&mpListResolv);
 
-	mCurlBound = false;
-	//procDbgLog("easy handle curl unbound");
+	curl_easy_cleanup(mpCurl);
+	mpCurl = NULL;
+#ifdef ENABLE_CURL_SHARE
+	sessionTerminate();
+#endif
 }
 
 /*
@@ -844,91 +829,29 @@ void HttpRequesting::processInfo(char *pBuf, char *pBufEnd)
 /* static functions */
 
 /*
+ * May run on the thread of CurlMultiplexing(). Only the
+ * results are stored and published by the release store
+ * of mDoneCurl. Everything else is done by the client
+ *
  * Literature
- * - https://curl.se/libcurl/c/curl_multi_perform.html
- * - https://curl.se/libcurl/c/curl_multi_info_read.html
  * - https://curl.se/libcurl/c/CURLINFO_RESPONSE_CODE.html
- * - https://curl.se/libcurl/c/CURLINFO_PRIVATE.html
  */
-void HttpRequesting::multiProcess()
+void HttpRequesting::curlDone(CURL *pCurl, CURLcode res, void *pUser)
 {
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mtxCurlMulti);
-#endif
-	int numRunningRequests, numMsgsLeft;
-	CURLMsg *curlMsg;
-	CURL *pCurl;
-	HttpRequesting *pReq;
-
-	curl_multi_perform(pCurlMulti, &numRunningRequests);
-
-	while (curlMsg = curl_multi_info_read(pCurlMulti, &numMsgsLeft), curlMsg)
-	{
-		//dbgLog("messages left: %d", numMsgsLeft);
-
-		if (curlMsg->msg != CURLMSG_DONE)
-			continue;
-
-		pCurl = curlMsg->easy_handle;
-
-		curl_easy_getinfo(pCurl, CURLINFO_PRIVATE, &pReq);
+	HttpRequesting *pReq = (HttpRequesting *)pUser;
 
-		if (pCurl != pReq->mpCurl)
-			wrnLog("pCurl (%p) does not match mpCurl (%p)", pCurl, pReq->mpCurl);
+	if (pCurl != pReq->mpCurl)
+		wrnLog("pCurl (%p) does not match mpCurl (%p)", pCurl, pReq->mpCurl);
 
-		pReq->mCurlRes = curlMsg->data.result;
-		curl_easy_getinfo(pCurl, CURLINFO_RESPONSE_CODE, &pReq->mRespCode);
+	pReq->mCurlRes = res;
+	curl_easy_getinfo(pCurl, CURLINFO_RESPONSE_CODE, &pReq->mRespCode);
 #if 0
-		dbgLog("curl msg done   %p", pReq);
-		dbgLog("result          %d", pReq->mCurlRes);
-		dbgLog("response code   %d", pReq->mRespCode);
-		dbgLog("url             %s", pReq->mUrl.substr(33).c_str());
-#endif
-		curl_multi_remove_handle(pCurlMulti, pCurl);
-		pReq->mCurlBound = false;
-		//dbgLog("easy handle curl unbound");
-
-		curlListFree(&pReq->mpListHeader);
-		curlListFree(&pReq->mpListResolv);
-
-		curl_easy_cleanup(pReq->mpCurl);
-		pReq->mpCurl = NULL;
-#ifdef ENABLE_CURL_SHARE
-		pReq->sessionTerminate();
+	dbgLog("curl msg done   %p", pReq);
+	dbgLog("result          %d", pReq->mCurlRes);
+	dbgLog("response code   %d", pReq->mRespCode);
+	dbgLog("url             %s", pReq->mUrl.substr(33).c_str());
 #endif
-		pReq->mDoneCurl = Positive;
-	}
-#if 0
-	--mRetries;
-	if (mRetries)
-	{
-		procDbgLog("retries left %d", mRetries);
-		success = Pending;
-	} else
-		procDbgLog("no retry");
-#endif
-}
-
-/*
- * Literature
- * - https://curl.se/mail/lib-2016-09/0047.html
- * - https://stackoverflow.com/questions/29845527/how-to-properly-uninitialize-openssl
- * - https://wiki.openssl.org/index.php/Library_Initialization
- * - Wichtig
- *   - https://rachelbythebay.com/w/2012/12/14/quiet/
- */
-void HttpRequesting::curlMultiDeInit()
-{
-#if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mtxCurlMulti);
-#endif
-	if (!pCurlMulti)
-		return;
-
-	curl_multi_cleanup(pCurlMulti);
-	pCurlMulti = NULL;
-
-	dbgLog("global deinit curl multi done");
+	pReq->mDoneCurl.store(Positive, memory_order_release);
 }
 
 extern "C" void HttpRequesting::sharedDataLock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
@@ -29,12 +29,14 @@
 #include <string>
 #include <list>
 #include <vector>
+#include <atomic>
 
 #include "Processing.h"
 #if CONFIG_LIB_DSPC_HAVE_C_ARES
 #include "DnsResolving.h"
 #endif
 #include "LibDspc.h"
+#include "CurlMultiplexing.h"
 
 #define numSharedDataTypes		4
 #define dHttpDefaultTimeoutMs		2700
@@ -110,8 +112,8 @@ private:
 
 	Success easyHandleCurlConfigure();
 	Success easyHandleCurlBind();
-	CURLM *multiHandleCurlInit();
 	void easyHandleCurlUnbind();
+	void easyHandleCurlRelease();
 	Success sessionCreate(const std::string &address, const uint16_t port);
 	void sessionTerminate();
 	void sharedDataMtxListDelete();
@@ -152,11 +154,10 @@ private:
 #if 0 // TODO: Implement
 	uint8_t mRetries;
 #endif
-	Success mDoneCurl;
+	std::atomic<Success> mDoneCurl; // Set by the thread driving the transfers
 
 	/* static functions */
-	static void multiProcess();
-	static void curlMultiDeInit();
+	static void curlDone(CURL *pCurl, CURLcode res, void *pUser);
 	static void sharedDataLock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr);
 	static void sharedDataUnLock(CURL *handle, curl_lock_data data, void *userptr);
 	static size_t curlDataToStringWrite(void *ptr, size_t size, size_t nmemb, std::string *pData);
@@ -165,9 +166,6 @@ private:
 	static void curlListFree(struct curl_slist **ppList);
 
 	/* static variables */
-	static std::mutex mtxCurlMulti;
-	static CURLM *pCurlMulti;
-
 	static std::mutex sessionMtx;
 	static std::list<HttpSession> sessions;
 
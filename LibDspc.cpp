@@ -44,6 +44,12 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #include "LibDspc.h"
 
@@ -59,6 +65,7 @@ using namespace CryptoPP;
 #define dLenIp4Max		15
 
 const char *hexDigits = "0123456789abcdef";
+const char *hexDigitsUpper = "0123456789ABCDEF";
 
 #if CONFIG_LIB_DSPC_HAVE_CURL
 static mutex mtxCurlGlobal;
@@ -244,21 +251,16 @@ size_t hexDumpPrint(char *pBuf, char *pBufEnd,
 string toHexStr(const string &strIn)
 {
 	string strOut;
-	char ch;
-
-	strOut.reserve(strIn.size() * 2);
-
-	for (size_t i = 0; i < strIn.size(); ++i)
-	{
-		ch = strIn[i];
 
-		strOut.push_back(hexDigits[ch >> 4]);
-		strOut.push_back(hexDigits[ch & 0xF]);
-	}
+	strOut.resize(strIn.size() * 2);
+	hexEncode(strIn.data(), strIn.size(), &strOut[0]);
 
 	return strOut;
 }
 
+/*
+ * Invalid digits are decoded as zero
+ */
 vector<char> toHex(const string &strIn)
 {
 	size_t szStr = strIn.size();
@@ -267,7 +269,12 @@ vector<char> toHex(const string &strIn)
 	vector<char> res;
 
 	if (szStr)
-		res.reserve((szStr + 1) >> 1);
+		res.resize((szStr + 1) >> 1);
+
+	if (!highByteDone && hexDecode(strIn.data(), szStr, res.data()))
+		return res;
+
+	res.clear();
 
 	for (size_t i = 0; i < szStr; ++i)
 	{
@@ -298,6 +305,200 @@ vector<char> toHex(const string &strIn)
 	return res;
 }
 
+#if defined(__SSE2__)
+static inline __m128i nibblesToAsciiSse2(__m128i n, __m128i offsAlpha)
+{
+	__m128i isAlpha = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+
+	n = _mm_add_epi8(n, _mm_set1_epi8('0'));
+
+	return _mm_add_epi8(n, _mm_and_si128(isAlpha, offsAlpha));
+}
+
+/*
+ * Returns false if at least one character is not a hex digit
+ */
+static inline bool asciiToNibblesSse2(__m128i v, __m128i &n)
+{
+	__m128i d, l, isDigit, isAlpha;
+
+	d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+	isDigit = _mm_and_si128(_mm_cmpgt_epi8(d, _mm_set1_epi8(-1)),
+				_mm_cmpgt_epi8(_mm_set1_epi8(10), d));
+
+	l = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	isAlpha = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8(-1)),
+				_mm_cmpgt_epi8(_mm_set1_epi8(6), l));
+
+	n = _mm_or_si128(_mm_and_si128(isDigit, d),
+			_mm_and_si128(isAlpha, _mm_add_epi8(l, _mm_set1_epi8(10))));
+
+	return _mm_movemask_epi8(_mm_or_si128(isDigit, isAlpha)) == 0xFFFF;
+}
+
+// Pairs of nibbles to bytes in 16 bit lanes. High nibble first
+static inline __m128i nibblesCombineSse2(__m128i n)
+{
+	return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(n, _mm_set1_epi16(0x00FF)), 4),
+				_mm_srli_epi16(n, 8));
+}
+#endif
+
+#if defined(__AVX2__)
+static inline __m256i nibblesToAsciiAvx2(__m256i n, __m256i offsAlpha)
+{
+	__m256i isAlpha = _mm256_cmpgt_epi8(n, _mm256_set1_epi8(9));
+
+	n = _mm256_add_epi8(n, _mm256_set1_epi8('0'));
+
+	return _mm256_add_epi8(n, _mm256_and_si256(isAlpha, offsAlpha));
+}
+
+static inline bool asciiToNibblesAvx2(__m256i v, __m256i &n)
+{
+	__m256i d, l, isDigit, isAlpha;
+
+	d = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+	isDigit = _mm256_and_si256(_mm256_cmpgt_epi8(d, _mm256_set1_epi8(-1)),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8(10), d));
+
+	l = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+	isAlpha = _mm256_and_si256(_mm256_cmpgt_epi8(l, _mm256_set1_epi8(-1)),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8(6), l));
+
+	n = _mm256_or_si256(_mm256_and_si256(isDigit, d),
+			_mm256_and_si256(isAlpha, _mm256_add_epi8(l, _mm256_set1_epi8(10))));
+
+	return _mm256_movemask_epi8(_mm256_or_si256(isDigit, isAlpha)) == -1;
+}
+
+static inline __m256i nibblesCombineAvx2(__m256i n)
+{
+	return _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(n, _mm256_set1_epi16(0x00FF)), 4),
+				_mm256_srli_epi16(n, 8));
+}
+#endif
+
+static inline int hexNibble(uint8_t ch)
+{
+	uint8_t d = ch - '0';
+	uint8_t l = (ch | 0x20) - 'a';
+
+	if (d < 10)
+		return d;
+
+	if (l < 6)
+		return l + 10;
+
+	return -1;
+}
+
+/*
+ * Writes exactly 2 * len characters. No null terminator.
+ * Uses AVX2 or SSE2 if enabled at compile time
+ */
+size_t hexEncode(const void *pData, size_t len, char *pOut, bool upper)
+{
+	const uint8_t *pIn = (const uint8_t *)pData;
+	const uint8_t *pEnd = pIn + len;
+	const char *pDigits = upper ? hexDigitsUpper : hexDigits;
+#if defined(__SSE2__)
+	char offsAlpha = upper ? 'A' - '0' - 10 : 'a' - '0' - 10;
+	__m128i mask = _mm_set1_epi8(0x0F);
+	__m128i offs = _mm_set1_epi8(offsAlpha);
+#endif
+#if defined(__AVX2__)
+	__m256i mask4 = _mm256_set1_epi8(0x0F);
+	__m256i offs256 = _mm256_set1_epi8(offsAlpha);
+
+	for (; pEnd - pIn >= 32; pIn += 32, pOut += 64)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)pIn);
+		__m256i hi = nibblesToAsciiAvx2(_mm256_and_si256(_mm256_srli_epi16(v, 4), mask4), offs256);
+		__m256i lo = nibblesToAsciiAvx2(_mm256_and_si256(v, mask4), offs256);
+
+		// Interleaving works per 128 bit lane
+		__m256i a = _mm256_unpacklo_epi8(hi, lo);
+		__m256i b = _mm256_unpackhi_epi8(hi, lo);
+
+		_mm256_storeu_si256((__m256i *)pOut, _mm256_permute2x128_si256(a, b, 0x20));
+		_mm256_storeu_si256((__m256i *)(pOut + 32), _mm256_permute2x128_si256(a, b, 0x31));
+	}
+#endif
+#if defined(__SSE2__)
+	for (; pEnd - pIn >= 16; pIn += 16, pOut += 32)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)pIn);
+		__m128i hi = nibblesToAsciiSse2(_mm_and_si128(_mm_srli_epi16(v, 4), mask), offs);
+		__m128i lo = nibblesToAsciiSse2(_mm_and_si128(v, mask), offs);
+
+		_mm_storeu_si128((__m128i *)pOut, _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *)(pOut + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+#endif
+	for (; pIn < pEnd; ++pIn)
+	{
+		*pOut++ = pDigits[*pIn >> 4];
+		*pOut++ = pDigits[*pIn & 0xF];
+	}
+
+	return len << 1;
+}
+
+/*
+ * Writes len / 2 bytes. Digits are case insensitive.
+ * Returns false on odd length or invalid digits.
+ * In this case the content of pOut is undefined
+ */
+bool hexDecode(const char *pIn, size_t len, void *pOut)
+{
+	const char *pEnd = pIn + len;
+	uint8_t *pDst = (uint8_t *)pOut;
+	int hi, lo;
+
+	if (len & 1)
+		return false;
+#if defined(__AVX2__)
+	for (; pEnd - pIn >= 64; pIn += 64, pDst += 32)
+	{
+		__m256i a, b;
+
+		if (!asciiToNibblesAvx2(_mm256_loadu_si256((const __m256i *)pIn), a) ||
+				!asciiToNibblesAvx2(_mm256_loadu_si256((const __m256i *)(pIn + 32)), b))
+			return false;
+
+		// Packing works per 128 bit lane
+		a = _mm256_packus_epi16(nibblesCombineAvx2(a), nibblesCombineAvx2(b));
+		_mm256_storeu_si256((__m256i *)pDst, _mm256_permute4x64_epi64(a, 0xD8));
+	}
+#endif
+#if defined(__SSE2__)
+	for (; pEnd - pIn >= 32; pIn += 32, pDst += 16)
+	{
+		__m128i a, b;
+
+		if (!asciiToNibblesSse2(_mm_loadu_si128((const __m128i *)pIn), a) ||
+				!asciiToNibblesSse2(_mm_loadu_si128((const __m128i *)(pIn + 16)), b))
+			return false;
+
+		_mm_storeu_si128((__m128i *)pDst,
+				_mm_packus_epi16(nibblesCombineSse2(a), nibblesCombineSse2(b)));
+	}
+#endif
+	for (; pIn < pEnd; pIn += 2)
+	{
+		hi = hexNibble(pIn[0]);
+		lo = hexNibble(pIn[1]);
+
+		if ((hi | lo) < 0)
+			return false;
+
+		*pDst++ = hi << 4 | lo;
+	}
+
+	return true;
+}
+
 size_t strReplace(string &strIn, const string &strFind, const string &strReplacement)
 {
 	size_t pos = strIn.find(strFind);
@@ -73,6 +73,8 @@ size_t hexDumpPrint(char *pBuf, char *pBufEnd,
 				const char *pName = NULL, size_t colWidth = 0x10);
 std::string toHexStr(const std::string &strIn);
 std::vector<char> toHex(const std::string &strIn);
+size_t hexEncode(const void *pData, size_t len, char *pOut, bool upper = false);
+bool hexDecode(const char *pIn, size_t len, void *pOut);
 size_t strReplace(std::string &strIn, const std::string &strFind, const std::string &strReplacement);
 
 // Json
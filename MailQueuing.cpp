@@ -0,0 +1,787 @@
+/*
+  This file is part of the DSP-Crowd project
+  https://www.dsp-crowd.com
+
+  Author(s):
+      - Johannes Natter, office@dsp-crowd.com
+
+  File created on 19.10.2026
+
+  Copyright (C) 2026, Johannes Natter
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cinttypes>
+#include <cstring>
+#include <unistd.h>
+#if defined(__linux__)
+#include <fcntl.h>
+#endif
+
+#include "MailQueuing.h"
+
+#define dForEach_ProcState(gen) \
+		gen(StStart) \
+		gen(StMain) \
+
+#define dGenProcStateEnum(s) s,
+dProcessStateEnum(ProcState);
+
+#if 1
+#define dGenProcStateString(s) #s,
+dProcessStateStr(ProcState);
+#endif
+
+using namespace std;
+
+const size_t cNumMailsPerSessionMax = 16;
+const uint32_t cMsBackoffMin = 2000;
+const uint32_t cMsBackoffMax = 600000;
+const uint32_t cNumBackoffShiftMax = 20;
+const uint64_t cTokensPerMail = 60000;
+const size_t cSizeRecordMax = 64 * 1024 * 1024;
+
+MailQueuing::MailQueuing()
+	: Processing("MailQueuing")
+	//, mStartMs(0)
+	, mAccounts()
+	, mServers()
+	, mLstSessions()
+	, mLstRetry()
+	, mIdxAccountNext(0)
+	, mNumSessionsMax(2)
+	, mNumMailsPerMinMax(0)
+	, mNumTriesMax(5)
+	, mMsTimeout(10000)
+	, mIdNext(1)
+	, mNumPending(0)
+	, mNumSent(0)
+	, mNumFailed(0)
+	, mLstIn()
+	, mPathSpool("")
+	, mpSpool(NULL)
+	, mBufSpool("")
+	, mOffsSpool(0)
+	, mSpoolDirty(false)
+{
+	mState = StStart;
+}
+
+/* member functions */
+
+/*
+ * The first account is used for mails without sender
+ */
+void MailQueuing::accountAdd(const string &server, const string &sender, const string &password)
+{
+	MqAccount account;
+
+	account.server = server;
+	account.sender = sender;
+	account.password = password;
+
+	mAccounts.push_back(account);
+}
+
+/*
+ * Mails not finished on exit are sent
+ * again on the next start. Passwords are
+ * never written to the spool
+ */
+void MailQueuing::spoolSet(const string &path)
+{
+	mPathSpool = path;
+}
+
+void MailQueuing::numSessionsMaxSet(size_t numMax)
+{
+	mNumSessionsMax = numMax ? numMax : 1;
+}
+
+/*
+ * Per server. 0: No limit
+ */
+void MailQueuing::numMailsPerMinMaxSet(size_t numMax)
+{
+	mNumMailsPerMinMax = numMax;
+}
+
+void MailQueuing::numTriesMaxSet(uint32_t numMax)
+{
+	mNumTriesMax = numMax ? numMax : 1;
+}
+
+void MailQueuing::msTimeoutSet(uint32_t msTimeout)
+{
+	mMsTimeout = msTimeout;
+}
+
+/*
+ * May be called from any thread. Never waits for the network
+ */
+void MailQueuing::mailAdd(const string &recipient, const string &subject,
+				const string &body, const string &sender)
+{
+	MqMail mail;
+
+	mail.id = 0;
+	mail.sender = sender;
+	mail.recipient = recipient;
+	mail.subject = subject;
+	mail.body = body;
+	mail.idxAccount = 0;
+	mail.numTries = 0;
+	mail.msRetry = 0;
+	mail.msBackoff = 0;
+
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mMtxIn);
+#endif
+	mLstIn.push_back(mail);
+}
+
+Success MailQueuing::process()
+{
+	//uint32_t curTimeMs = millis();
+	//uint32_t diffMs = curTimeMs - mStartMs;
+	vector<MqAccount>::iterator iter;
+	Success success;
+#if 0
+	dStateTrace;
+#endif
+	switch (mState)
+	{
+	case StStart:
+
+		if (!mAccounts.size())
+			return procErrLog(-1, "no account configured");
+
+		for (iter = mAccounts.begin(); iter != mAccounts.end(); ++iter)
+		{
+			MqServer &server = mServers[iter->server];
+
+			server.tokens = mNumMailsPerMinMax * cTokensPerMail;
+			server.msRefill = millis();
+		}
+
+		if (mPathSpool.size())
+		{
+			success = spoolReplay();
+			if (success != Positive)
+				return procErrLog(-1, "could not replay spool");
+		}
+
+		mState = StMain;
+
+		break;
+	case StMain:
+
+		mailsIntake();
+		sessionsCheck();
+		retriesCheck();
+
+		// Mails are sent only if their records are on disk
+		success = spoolFlush();
+		if (success == Pending)
+			break;
+
+		if (success != Positive)
+			return procErrLog(-1, "could not flush spool");
+
+		sessionsStart();
+
+		break;
+	default:
+		break;
+	}
+
+	return Pending;
+}
+
+/*
+ * Mails of canceled sessions stay in the spool.
+ * Mails added since the last cycle are spooled as well
+ */
+Success MailQueuing::shutdown()
+{
+	list<MqSession>::iterator iter;
+
+	iter = mLstSessions.begin();
+	for (; iter != mLstSessions.end(); ++iter)
+		cancel(iter->pMail);
+
+	mLstSessions.clear();
+
+	if (mpSpool)
+		mailsIntake();
+
+	spoolFlush();
+
+	if (mpSpool)
+	{
+		fclose(mpSpool);
+		mpSpool = NULL;
+	}
+
+	return Positive;
+}
+
+/*
+ * Producers are only blocked for the splice
+ */
+void MailQueuing::mailsIntake()
+{
+	list<MqMail>::iterator iter;
+	list<MqMail> lstIn;
+
+	{
+#if CONFIG_PROC_HAVE_DRIVERS
+		Guard lock(mMtxIn);
+#endif
+		lstIn.splice(lstIn.end(), mLstIn);
+	}
+
+	iter = lstIn.begin();
+	while (iter != lstIn.end())
+	{
+		// Recovered mails are in the spool already
+		if (!iter->id)
+		{
+			iter->id = mIdNext++;
+			spoolAppend(*iter);
+		}
+
+		++mNumPending;
+
+		mailRoute(lstIn, iter++);
+	}
+}
+
+void MailQueuing::mailRoute(list<MqMail> &lstSrc, list<MqMail>::iterator iter)
+{
+	size_t idx = 0;
+
+	if (iter->sender.size())
+	{
+		for (; idx < mAccounts.size(); ++idx)
+		{
+			if (mAccounts[idx].sender == iter->sender)
+				break;
+		}
+	}
+
+	if (idx >= mAccounts.size())
+	{
+		procWrnLog("no account for sender %s", iter->sender.c_str());
+
+		++mNumFailed;
+		--mNumPending;
+		spoolDoneAppend(iter->id);
+
+		lstSrc.erase(iter);
+		return;
+	}
+
+	iter->idxAccount = idx;
+
+	MqAccount &account = mAccounts[idx];
+	account.lstReady.splice(account.lstReady.end(), lstSrc, iter);
+}
+
+void MailQueuing::retriesCheck()
+{
+	list<MqMail>::iterator iter;
+	uint32_t curTimeMs = millis();
+
+	iter = mLstRetry.begin();
+	while (iter != mLstRetry.end())
+	{
+		if (curTimeMs - iter->msRetry < iter->msBackoff)
+		{
+			++iter;
+			continue;
+		}
+
+		mailRoute(mLstRetry, iter++);
+	}
+}
+
+void MailQueuing::sessionsCheck()
+{
+	list<MqSession>::iterator iter;
+	Success success;
+	size_t i;
+
+	iter = mLstSessions.begin();
+	while (iter != mLstSessions.end())
+	{
+		success = iter->pMail->success();
+		if (success == Pending)
+		{
+			++iter;
+			continue;
+		}
+
+		if (success != Positive)
+			procDbgLog("session to %s failed", iter->server.c_str());
+
+		// Mails not tried by a failed session are Pending
+		for (i = 0; i < iter->mails.size(); ++i)
+			mailFinish(iter->mails[i], iter->pMail->msgSuccess(i),
+					iter->pMail->msgRespCode(i));
+
+		repel(iter->pMail);
+
+		iter = mLstSessions.erase(iter);
+	}
+}
+
+/*
+ * Accounts take turns to start a session
+ */
+void MailQueuing::sessionsStart()
+{
+	size_t numAccounts = mAccounts.size();
+	size_t i;
+
+	for (i = 0; i < numAccounts; ++i)
+	{
+		if (mLstSessions.size() >= mNumSessionsMax)
+			break;
+
+		MqAccount &account = mAccounts[(mIdxAccountNext + i) % numAccounts];
+
+		if (!account.lstReady.size())
+			continue;
+
+		sessionStart(account, mServers[account.server]);
+	}
+
+	mIdxAccountNext = (mIdxAccountNext + 1) % numAccounts;
+}
+
+/*
+ * Up to 16 mails are sent over one SMTP session
+ */
+bool MailQueuing::sessionStart(MqAccount &account, MqServer &server)
+{
+	MailSending *pMail;
+	size_t numMails, i;
+
+	numMails = PMIN(cNumMailsPerSessionMax, account.lstReady.size());
+
+	if (!tokensTake(server, numMails))
+		return false;
+
+	pMail = MailSending::create();
+	if (!pMail)
+	{
+		procWrnLog("could not create process");
+		return false;
+	}
+
+	pMail->serverSet(account.server);
+	pMail->senderSet(account.sender);
+	pMail->passwordSet(account.password);
+	pMail->msTimeoutSet(mMsTimeout);
+
+	mLstSessions.emplace_back();
+
+	MqSession &session = mLstSessions.back();
+
+	session.pMail = pMail;
+	session.server = account.server;
+	session.mails.reserve(numMails);
+
+	for (i = 0; i < numMails; ++i)
+	{
+		MqMail &mail = account.lstReady.front();
+
+		pMail->msgAdd(mail.recipient, mail.subject, mail.body);
+
+		session.mails.push_back(std::move(mail));
+		account.lstReady.pop_front();
+	}
+
+	start(pMail);
+
+	return true;
+}
+
+/*
+ * Mails rejected permanently by the
+ * server are not tried again.
+ * Mails not reached by a failed session
+ * are delayed without counting a try
+ */
+void MailQueuing::mailFinish(MqMail &mail, Success success, long respCode)
+{
+	uint32_t shift;
+
+	if (success == Pending)
+	{
+		mail.msRetry = millis();
+		mail.msBackoff = cMsBackoffMin;
+
+		mLstRetry.push_back(std::move(mail));
+		return;
+	}
+
+	++mail.numTries;
+
+	if (success == Positive)
+	{
+		++mNumSent;
+		--mNumPending;
+		spoolDoneAppend(mail.id);
+		return;
+	}
+
+	if (respPermanent(respCode))
+	{
+		procWrnLog("mail %" PRIu32 " to %s rejected by server: %ld",
+				mail.id, mail.recipient.c_str(), respCode);
+
+		++mNumFailed;
+		--mNumPending;
+		spoolDoneAppend(mail.id);
+		return;
+	}
+
+	if (mail.numTries >= mNumTriesMax)
+	{
+		procWrnLog("could not send mail %" PRIu32 " to %s after %" PRIu32 " tries",
+				mail.id, mail.recipient.c_str(), mail.numTries);
+
+		++mNumFailed;
+		--mNumPending;
+		spoolDoneAppend(mail.id);
+		return;
+	}
+
+	// Exponential backoff
+	shift = PMIN(mail.numTries - 1, cNumBackoffShiftMax);
+
+	mail.msRetry = millis();
+	mail.msBackoff = PMIN(cMsBackoffMin << shift, cMsBackoffMax);
+
+	procDbgLog("retrying mail %" PRIu32 " in %" PRIu32 "ms", mail.id, mail.msBackoff);
+
+	mLstRetry.push_back(std::move(mail));
+}
+
+/*
+ * Tokens are refilled continuously. The
+ * bucket holds the mails of one minute
+ */
+bool MailQueuing::tokensTake(MqServer &server, size_t &numMails)
+{
+	uint64_t tokensMax = mNumMailsPerMinMax * cTokensPerMail;
+	uint32_t curTimeMs = millis();
+	uint64_t numAvail;
+
+	if (!mNumMailsPerMinMax)
+		return true;
+
+	server.tokens += (uint64_t)(curTimeMs - server.msRefill) * mNumMailsPerMinMax;
+	server.tokens = PMIN(server.tokens, tokensMax);
+	server.msRefill = curTimeMs;
+
+	numAvail = server.tokens / cTokensPerMail;
+	if (!numAvail)
+		return false;
+
+	numMails = PMIN(numMails, numAvail);
+	server.tokens -= numMails * cTokensPerMail;
+
+	return true;
+}
+
+/*
+ * Spool format. Append only
+ *   A <id> <len sender> <len recipient> <len subject> <len body>\n<data>\n
+ *   D <id>\n
+ * Reading stops at the first incomplete record.
+ * Pending mails are rewritten on start
+ */
+Success MailQueuing::spoolReplay()
+{
+	size_t lenSender, lenRecipient, lenSubject, lenBody;
+	map<uint32_t, MqMail>::iterator iter;
+	map<uint32_t, MqMail> mails;
+	uint32_t id, idMax = 0;
+	string pathTmp;
+	char line[128];
+	FILE *pFile;
+
+	pFile = fopen(mPathSpool.c_str(), "rb");
+	if (!pFile && errno != ENOENT)
+		return procErrLog(-1, "could not open spool %s: %s",
+					mPathSpool.c_str(), strerror(errno));
+
+	while (pFile && fgets(line, sizeof(line), pFile))
+	{
+		if (sscanf(line, "D %" SCNu32, &id) == 1)
+		{
+			mails.erase(id);
+			continue;
+		}
+
+		if (sscanf(line, "A %" SCNu32 " %zu %zu %zu %zu", &id,
+				&lenSender, &lenRecipient, &lenSubject, &lenBody) != 5)
+			break;
+
+		if (lenSender + lenRecipient + lenSubject + lenBody > cSizeRecordMax)
+			break;
+
+		MqMail mail;
+
+		if (!fieldRead(pFile, lenSender, mail.sender) ||
+				!fieldRead(pFile, lenRecipient, mail.recipient) ||
+				!fieldRead(pFile, lenSubject, mail.subject) ||
+				!fieldRead(pFile, lenBody, mail.body) ||
+				fgetc(pFile) != '\n')
+			break;
+
+		mail.id = id;
+		mail.idxAccount = 0;
+		mail.numTries = 0;
+		mail.msRetry = 0;
+		mail.msBackoff = 0;
+
+		mails[id] = std::move(mail);
+		idMax = PMAX(idMax, id);
+	}
+
+	if (pFile)
+		fclose(pFile);
+
+	mIdNext = idMax + 1;
+
+	if (mails.size())
+		procInfLog("recovered %zu mails from spool", mails.size());
+
+	// Compaction. Also drops incomplete records
+	pathTmp = mPathSpool + ".tmp";
+
+	mpSpool = fopen(pathTmp.c_str(), "wb");
+	if (!mpSpool)
+		return procErrLog(-1, "could not open spool %s: %s",
+					pathTmp.c_str(), strerror(errno));
+
+	for (iter = mails.begin(); iter != mails.end(); ++iter)
+		spoolAppend(iter->second);
+
+	// Old spool is replaced only if the new one is on disk
+	if (fwrite(mBufSpool.data(), 1, mBufSpool.size(), mpSpool) != mBufSpool.size() ||
+			!spoolSync())
+	{
+		procErrLog(-1, "could not write spool: %s", strerror(errno));
+		goto errSpool;
+	}
+
+	if (rename(pathTmp.c_str(), mPathSpool.c_str()))
+	{
+		procErrLog(-1, "could not rename spool: %s", strerror(errno));
+		goto errSpool;
+	}
+
+	if (!dirSync(mPathSpool))
+		procWrnLog("could not sync spool directory: %s", strerror(errno));
+
+	mOffsSpool = (long)mBufSpool.size();
+	mSpoolDirty = mBufSpool.size() > 0;
+	mBufSpool.clear();
+
+	{
+#if CONFIG_PROC_HAVE_DRIVERS
+		Guard lock(mMtxIn);
+#endif
+		for (iter = mails.begin(); iter != mails.end(); ++iter)
+			mLstIn.push_back(std::move(iter->second));
+	}
+
+	return Positive;
+
+errSpool:
+	fclose(mpSpool);
+	mpSpool = NULL;
+	mBufSpool.clear();
+
+	remove(pathTmp.c_str());
+
+	return -1;
+}
+
+void MailQueuing::spoolAppend(const MqMail &mail)
+{
+	char buf[96];
+
+	if (!mpSpool)
+		return;
+
+	snprintf(buf, sizeof(buf), "A %" PRIu32 " %zu %zu %zu %zu\n", mail.id,
+			mail.sender.size(), mail.recipient.size(),
+			mail.subject.size(), mail.body.size());
+
+	mBufSpool.append(buf);
+	mBufSpool.append(mail.sender);
+	mBufSpool.append(mail.recipient);
+	mBufSpool.append(mail.subject);
+	mBufSpool.append(mail.body);
+	mBufSpool.append("\n");
+}
+
+void MailQueuing::spoolDoneAppend(uint32_t id)
+{
+	char buf[24];
+
+	if (!mpSpool)
+		return;
+
+	snprintf(buf, sizeof(buf), "D %" PRIu32 "\n", id);
+	mBufSpool.append(buf);
+}
+
+/*
+ * Records of one cycle are written at once.
+ * On error the spool is cut back to the last
+ * complete write. Replay would stop at a torn
+ * record. The records are written again in
+ * the next cycle.
+ * The spool is truncated when no mail is pending
+ *
+ * Returns
+ * - Positive: Records on disk
+ * - Pending: Write failed. Retried in the next cycle
+ * - < 0: Spool lost
+ */
+Success MailQueuing::spoolFlush()
+{
+	size_t numWritten;
+
+	if (!mpSpool)
+		return Positive;
+
+	// Spool is truncated anyway
+	if (mBufSpool.size() && !mNumPending)
+		mBufSpool.clear();
+
+	if (mBufSpool.size())
+	{
+		numWritten = fwrite(mBufSpool.data(), 1, mBufSpool.size(), mpSpool);
+		if (numWritten != mBufSpool.size() || !spoolSync())
+		{
+			procWrnLog("could not write spool: %s", strerror(errno));
+
+			clearerr(mpSpool);
+
+			if (ftruncate(fileno(mpSpool), mOffsSpool) ||
+					fseek(mpSpool, mOffsSpool, SEEK_SET))
+				procWrnLog("could not truncate spool: %s", strerror(errno));
+
+			return Pending;
+		}
+
+		mOffsSpool += (long)mBufSpool.size();
+		mBufSpool.clear();
+		mSpoolDirty = true;
+	}
+
+	if (!mSpoolDirty || mNumPending)
+		return Positive;
+
+	mpSpool = freopen(mPathSpool.c_str(), "wb", mpSpool);
+	if (!mpSpool)
+		return procErrLog(-1, "could not truncate spool: %s", strerror(errno));
+
+	mOffsSpool = 0;
+	mSpoolDirty = false;
+
+	return Positive;
+}
+
+/*
+ * Records must be on disk before the
+ * corresponding mails are sent
+ */
+bool MailQueuing::spoolSync()
+{
+	if (fflush(mpSpool))
+		return false;
+
+	return !fsync(fileno(mpSpool));
+}
+
+void MailQueuing::processInfo(char *pBuf, char *pBufEnd)
+{
+#if 1
+	dInfo("State\t\t\t%s\n", ProcStateString[mState]);
+#endif
+	dInfo("Pending\t\t\t%zu\n", mNumPending);
+	dInfo("Sent\t\t\t%zu\n", mNumSent);
+	dInfo("Failed\t\t\t%zu\n", mNumFailed);
+	dInfo("Sessions\t\t%zu\n", mLstSessions.size());
+	dInfo("Retries\t\t\t%zu\n", mLstRetry.size());
+}
+
+/* static functions */
+
+bool MailQueuing::fieldRead(FILE *pFile, size_t len, string &str)
+{
+	str.resize(len);
+
+	if (!len)
+		return true;
+
+	return fread(&str[0], 1, len, pFile) == len;
+}
+
+/*
+ * Makes a rename durable
+ */
+bool MailQueuing::dirSync(const string &path)
+{
+#if defined(__linux__)
+	size_t pos = path.find_last_of('/');
+	string dir = pos == string::npos ? "." : path.substr(0, pos + 1);
+	int fd, res;
+
+	fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return false;
+
+	res = fsync(fd);
+	close(fd);
+
+	return !res;
+#else
+	(void)path;
+	return true;
+#endif
+}
+
+/*
+ * SMTP 5xx. Authentication failures depend on
+ * the account and not on the mail
+ */
+bool MailQueuing::respPermanent(long respCode)
+{
+	if (respCode < 500 || respCode > 599)
+		return false;
+
+	return respCode != 530 && respCode != 534 && respCode != 535;
+}
+
@@ -0,0 +1,179 @@
+/*
+  This file is part of the DSP-Crowd project
+  https://www.dsp-crowd.com
+
+  Author(s):
+      - Johannes Natter, office@dsp-crowd.com
+
+  File created on 19.10.2026
+
+  Copyright (C) 2026, Johannes Natter
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MAIL_QUEUING_H
+#define MAIL_QUEUING_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <cstdio>
+
+#include "Processing.h"
+#include "MailSending.h"
+
+struct MqMail
+{
+	uint32_t id;
+	std::string sender; // Selects account. Empty: First account
+	std::string recipient;
+	std::string subject;
+	std::string body;
+	size_t idxAccount;
+	uint32_t numTries;
+	uint32_t msRetry; // Start of backoff
+	uint32_t msBackoff;
+};
+
+struct MqAccount
+{
+	std::string server;
+	std::string sender;
+	std::string password;
+	std::list<MqMail> lstReady;
+};
+
+// Rate limiting per server. Token bucket
+struct MqServer
+{
+	uint64_t tokens; // In 1/60000 mails
+	uint32_t msRefill;
+};
+
+struct MqSession
+{
+	MailSending *pMail;
+	std::string server;
+	std::vector<MqMail> mails;
+};
+
+class MailQueuing : public Processing
+{
+
+public:
+
+	static MailQueuing *create()
+	{
+		return new dNoThrow MailQueuing;
+	}
+
+	void accountAdd(const std::string &server,
+			const std::string &sender,
+			const std::string &password);
+	void spoolSet(const std::string &path);
+	void numSessionsMaxSet(size_t numMax);
+	void numMailsPerMinMaxSet(size_t numMax);
+	void numTriesMaxSet(uint32_t numMax);
+	void msTimeoutSet(uint32_t msTimeout);
+
+	void mailAdd(const std::string &recipient,
+			const std::string &subject,
+			const std::string &body,
+			const std::string &sender = "");
+
+	size_t numMailsPending() const
+	{ return mNumPending; }
+	size_t numMailsSent() const
+	{ return mNumSent; }
+	size_t numMailsFailed() const
+	{ return mNumFailed; }
+
+protected:
+
+	virtual ~MailQueuing() {}
+
+private:
+
+	MailQueuing();
+	MailQueuing(const MailQueuing &) = delete;
+	MailQueuing &operator=(const MailQueuing &) = delete;
+
+	/*
+	 * Naming of functions:  objectVerb()
+	 * Example:              peerAdd()
+	 */
+
+	/* member functions */
+	Success process();
+	Success shutdown();
+	void processInfo(char *pBuf, char *pBufEnd);
+
+	void mailsIntake();
+	void mailRoute(std::list<MqMail> &lstSrc, std::list<MqMail>::iterator iter);
+	void retriesCheck();
+	void sessionsCheck();
+	void sessionsStart();
+	bool sessionStart(MqAccount &account, MqServer &server);
+	void mailFinish(MqMail &mail, Success success, long respCode);
+	bool tokensTake(MqServer &server, size_t &numMails);
+	Success spoolReplay();
+	void spoolAppend(const MqMail &mail);
+	void spoolDoneAppend(uint32_t id);
+	Success spoolFlush();
+	bool spoolSync();
+
+	/* member variables */
+	//uint32_t mStartMs;
+	std::vector<MqAccount> mAccounts;
+	std::map<std::string, MqServer> mServers;
+	std::list<MqSession> mLstSessions;
+	std::list<MqMail> mLstRetry;
+	size_t mIdxAccountNext;
+	size_t mNumSessionsMax;
+	size_t mNumMailsPerMinMax;
+	uint32_t mNumTriesMax;
+	uint32_t mMsTimeout;
+	uint32_t mIdNext;
+	size_t mNumPending;
+	size_t mNumSent;
+	size_t mNumFailed;
+
+	// Producers
+#if CONFIG_PROC_HAVE_DRIVERS
+	std::mutex mMtxIn;
+#endif
+	std::list<MqMail> mLstIn;
+
+	// Spool
+	std::string mPathSpool;
+	FILE *mpSpool;
+	std::string mBufSpool;
+	long mOffsSpool; // End of the last complete write
+	bool mSpoolDirty;
+
+	/* static functions */
+	static bool fieldRead(FILE *pFile, size_t len, std::string &str);
+	static bool dirSync(const std::string &path);
+	static bool respPermanent(long respCode);
+
+	/* static variables */
+
+	/* constants */
+
+};
+
+#endif
+
@@ -23,6 +23,10 @@
   along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cinttypes>
+#include <sys/stat.h>
+#include <string.h>
+
 #include "MailSending.h"
 
 #if 1
@@ -35,13 +39,29 @@ using namespace std;
 #define dMailSendTimeoutMs			1000
 #define dSmtpCodeActionOkeyCompleted	250
 
-mutex MailSending::mtxCurlMulti;
-CURLM *MailSending::pCurlMulti = NULL;
+mutex MailSending::sessionMtx;
+list<MailSession> MailSending::sessions;
+bool MailSending::sessionsDeInitRegistered = false;
+
+const size_t cNumSessionHandlesMax = 8;
+const uint32_t cMsSessionIdleMax = 60000;
+
+// RFC 5321 4.5.3.1.8: Servers must accept at least 100 recipients
+const size_t cNumRcptsPerMsgMaxDefault = 100;
+
+const long cSizeBufUpload = 64 * 1024;
+const size_t cSizeLineRaw = 57; // RFC 2045: Max. 76 characters per line
+const size_t cSizeLineEnc = 78;
+const size_t cNumLinesChunk = 256;
+
+static const char *cBase64Chars =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
 MailSending::MailSending()
 	: Processing("MailSending")
 	, mState(MailSeStart)
 	, mStartMs(0)
+	, mMsTimeout(dMailSendTimeoutMs)
 	, mServer("")
 	, mPort(465)
 	, mPassword("")
@@ -51,27 +71,37 @@ MailSending::MailSending()
 	, mSenderName("")
 	, mSubject("")
 	, mBody("")
+	, mData("")
+	, mDataParts("")
+	, mBoundary("")
+	, mAttachments()
+	, mSegments()
+	, mIdxSeg(0)
+	, mOffSeg(0)
+	, mpFile(NULL)
+	, mLenLine(0)
+	, mOffLine(0)
+	, mReadFailed(false)
+	, mMsgs()
+	, mIdxMsg(0)
+	, mNumMsgsFailed(0)
+	, mRecipients()
+	, mHdrRcpts("")
+	, mNumRcptsPerMsgMax(cNumRcptsPerMsgMaxDefault)
+	, mNumRcptsFailed(0)
+	, mNumRcptsSent(0)
+	, mNumRcptsAck(0)
 	, mpCurl(NULL)
+	, mCurlBound(false)
 	, mpListRecipients(NULL)
 	, mNumSent(0)
 	, mDone(Pending)
-	, mCurlRes(CURLE_OK)
-	, mRespCode(0)
 {}
 
 MailSending::~MailSending()
 {
-	if (mpListRecipients)
-	{
-		curl_slist_free_all(mpListRecipients);
-		mpListRecipients = NULL;
-	}
-
-	if (mpCurl)
-	{
-		curl_easy_cleanup(mpCurl);
-		mpCurl = NULL;
-	}
+	easyHandleRelease(false);
+	fileClose();
 }
 
 /* member functions */
@@ -110,11 +140,140 @@ void MailSending::bodySet(const string &body)
 	mBody = body;
 }
 
+/*
+ * Measured from the last upload progress
+ */
+void MailSending::msTimeoutSet(uint32_t msTimeout)
+{
+	mMsTimeout = msTimeout;
+}
+
+/*
+ * All messages are sent one after another
+ * using the same authenticated connection
+ */
+void MailSending::msgAdd(const string &recipient, const string &subject, const string &body)
+{
+	MailMsg msg;
+
+	nameAddrSplit(recipient, msg.recipientName, msg.recipientAddr);
+
+	msg.subject = subject;
+	msg.body = body;
+	msg.success = Pending;
+	msg.curlRes = CURLE_OK;
+	msg.respCode = 0;
+	msg.idxRcpt = 0;
+	msg.numRcpts = 0;
+
+	mMsgs.push_back(msg);
+}
+
+/*
+ * Recipients share one message.
+ * They are sent in groups of RCPT commands per transaction
+ */
+void MailSending::recipientAdd(const string &recipient, MailRcptType type)
+{
+	MailRecipient rcpt;
+
+	nameAddrSplit(recipient, rcpt.name, rcpt.addr);
+
+	rcpt.type = type;
+	rcpt.success = Pending;
+
+	mRecipients.push_back(rcpt);
+}
+
+void MailSending::numRcptsPerMsgMaxSet(size_t numMax)
+{
+	mNumRcptsPerMsgMax = numMax ? numMax : 1;
+}
+
+Success MailSending::recipientSuccess(size_t idx) const
+{
+	if (idx >= mRecipients.size())
+		return -1;
+
+	return mRecipients[idx].success;
+}
+
+/*
+ * Name and content type become part headers.
+ * An invalid content type is replaced
+ */
+void MailSending::attachmentAdd(const string &name, const string &data, const string &contentType)
+{
+	MailAttachment att;
+
+	att.name = paramQuote(name);
+	att.contentType = contentType;
+	att.data = data;
+
+	if (!headerValueValid(att.contentType))
+	{
+		procWrnLog("invalid content type of attachment. Using default");
+		att.contentType = "application/octet-stream";
+	}
+
+	mAttachments.push_back(att);
+}
+
+/*
+ * The file is opened while sending the message.
+ * Its content is never loaded into memory at once
+ */
+void MailSending::attachmentFileAdd(const string &path, const string &name, const string &contentType)
+{
+	MailAttachment att;
+	size_t pos;
+
+	att.name = name;
+	att.contentType = contentType;
+	att.path = path;
+
+	if (!att.name.size())
+	{
+		pos = path.find_last_of("/\\");
+		att.name = pos == string::npos ? path : path.substr(pos + 1);
+	}
+
+	att.name = paramQuote(att.name);
+
+	if (!headerValueValid(att.contentType))
+	{
+		procWrnLog("invalid content type of attachment. Using default");
+		att.contentType = "application/octet-stream";
+	}
+
+	mAttachments.push_back(att);
+}
+
+Success MailSending::msgSuccess(size_t idx) const
+{
+	if (idx >= mMsgs.size())
+		return -1;
+
+	return mMsgs[idx].success;
+}
+
+/*
+ * Last SMTP reply code. 0: No reply
+ */
+long MailSending::msgRespCode(size_t idx) const
+{
+	if (idx >= mMsgs.size())
+		return 0;
+
+	return mMsgs[idx].respCode;
+}
+
 Success MailSending::process()
 {
 	uint32_t curTimeMs = millis();
-	uint32_t diffMs = curTimeMs - mStartMs;
+	uint32_t diffMs = curTimeMs - mStartMs.load(memory_order_relaxed);
 	Success success;
+	MailMsg *pMsg;
 #if 0
 	procWrnLog("mState = %s", MailSeStateString[mState]);
 #endif
@@ -124,39 +283,99 @@ Success MailSending::process()
 
 		curlGlobalInit();
 
+		if (mRecipients.size())
+			rcptMsgsCreate();
+
+		// Single message configured using setters
+		if (!mMsgs.size())
+		{
+			mMsgs.resize(1);
+			pMsg = &mMsgs.back();
+
+			pMsg->recipientAddr = mRecipientAddr;
+			pMsg->recipientName = mRecipientName;
+			pMsg->subject = mSubject;
+			pMsg->body = mBody;
+			pMsg->success = Pending;
+			pMsg->curlRes = CURLE_OK;
+			pMsg->respCode = 0;
+			pMsg->idxRcpt = 0;
+			pMsg->numRcpts = 0;
+		}
+
+		if (mAttachments.size())
+		{
+			char buf[48];
+
+			snprintf(buf, sizeof(buf), "=_MailSending_%08" PRIx32 "_%" PRIxPTR,
+						curTimeMs, (uintptr_t)this);
+			mBoundary = buf;
+		}
+
+		mState = MailSeMsgStart;
+
+		break;
+	case MailSeMsgStart:
+
+		if (mIdxMsg >= mMsgs.size())
+		{
+			if (mNumMsgsFailed)
+				return procErrLog(-1, "could not send %zu of %zu mails",
+							mNumMsgsFailed, mMsgs.size());
+
+			if (mNumRcptsFailed)
+				procWrnLog("%zu of %zu recipients rejected",
+							mNumRcptsFailed, mRecipients.size());
+
+			return Positive;
+		}
+
 		success = easyHandleCreate();
 		if (success != Positive)
 			return procErrLog(-1, "could not create curl easy handle");
 
+		mStartMs = curTimeMs;
+
 		success = curlEasyHandleBind();
 		if (success != Positive)
 			return procErrLog(-1, "could not bind curl easy handle");
 
-		multiProcess();
+		CurlMultiplexing::transfersProcess();
 
-		mStartMs = curTimeMs;
 		mState = MailSeDoneWait;
 
 		break;
 	case MailSeDoneWait:
 
-		multiProcess();
+		CurlMultiplexing::transfersProcess();
 
-		if (diffMs > dMailSendTimeoutMs)
-			return procErrLog(-1, "timeout sending mail");
+		if (mDone.load(memory_order_acquire) == Pending)
+		{
+			// Measured from last upload progress
+			if (diffMs > mMsTimeout)
+				msgFinish(procErrLog(-1, "timeout sending mail"));
 
-		if (mDone == Pending)
 			break;
+		}
+
+		pMsg = &mMsgs[mIdxMsg];
 
-		if (mCurlRes != CURLE_OK)
-			return procErrLog(-1, "curl performing failed: %s (%d)", curl_easy_strerror(mCurlRes), mCurlRes);
+		if (pMsg->curlRes != CURLE_OK)
+		{
+			msgFinish(procErrLog(-1, "curl performing failed: %s (%d)",
+					curl_easy_strerror(pMsg->curlRes), pMsg->curlRes));
+			break;
+		}
 
-		procDbgLog("server returned status code %d", mRespCode);
+		procDbgLog("server returned status code %d", pMsg->respCode);
 
-		if (mRespCode != dSmtpCodeActionOkeyCompleted)
-			return procErrLog(-1, "SMTP server did not return %d", dSmtpCodeActionOkeyCompleted);
+		if (pMsg->respCode != dSmtpCodeActionOkeyCompleted)
+		{
+			msgFinish(procErrLog(-1, "SMTP server did not return %d", dSmtpCodeActionOkeyCompleted));
+			break;
+		}
 
-		return Positive;
+		msgFinish(Positive);
 
 		break;
 	default:
@@ -166,6 +385,138 @@ Success MailSending::process()
 	return Pending;
 }
 
+/*
+ * Only handles of successful transfers are reused.
+ * Their connections are known to be authenticated and healthy.
+ * The handle is unbound first. Afterwards no cURL callback
+ * writes the results of the recipients anymore
+ */
+void MailSending::msgFinish(Success success)
+{
+	curlEasyHandleUnbind();
+
+	mMsgs[mIdxMsg].success = success;
+
+	rcptsFinish(&mMsgs[mIdxMsg], success);
+
+	if (success != Positive)
+		++mNumMsgsFailed;
+
+	easyHandleRelease(success == Positive);
+	fileClose();
+
+	mDone.store(Pending, memory_order_relaxed);
+	mNumSent = 0;
+	++mIdxMsg;
+
+	mState = MailSeMsgStart;
+}
+
+/*
+ * Headers list all To and Cc recipients in every transaction.
+ * Bcc recipients only appear in RCPT commands
+ */
+void MailSending::rcptMsgsCreate()
+{
+	vector<MailRecipient>::const_iterator iter;
+	const char *pHdrs[] = { "To: ", "Cc: " };
+	MailRcptType types[] = { MailRcptTo, MailRcptCc };
+	bool first;
+	MailMsg msg;
+	size_t i;
+
+	mHdrRcpts.clear();
+
+	for (i = 0; i < 2; ++i)
+	{
+		first = true;
+
+		for (iter = mRecipients.begin(); iter != mRecipients.end(); ++iter)
+		{
+			if (iter->type != types[i])
+				continue;
+
+			mHdrRcpts.append(first ? pHdrs[i] : ",\r\n ");
+			mHdrRcpts.append(iter->name).append(" <");
+			mHdrRcpts.append(iter->addr).append(">");
+
+			first = false;
+		}
+
+		if (!first)
+			mHdrRcpts.append("\r\n");
+		else if (types[i] == MailRcptTo)
+			mHdrRcpts.append("To: undisclosed-recipients:;\r\n");
+	}
+
+	msg.subject = mSubject;
+	msg.body = mBody;
+	msg.success = Pending;
+	msg.curlRes = CURLE_OK;
+	msg.respCode = 0;
+
+	for (i = 0; i < mRecipients.size(); i += mNumRcptsPerMsgMax)
+	{
+		msg.idxRcpt = i;
+		msg.numRcpts = PMIN(mNumRcptsPerMsgMax, mRecipients.size() - i);
+
+		mMsgs.push_back(msg);
+	}
+
+	procDbgLog("%zu recipients in %zu transactions",
+			mRecipients.size(), mMsgs.size());
+}
+
+/*
+ * Accepted recipients only received the mail if
+ * the whole transaction succeeded
+ */
+void MailSending::rcptsFinish(const MailMsg *pMsg, Success success)
+{
+	size_t i;
+
+	for (i = pMsg->idxRcpt; i < pMsg->idxRcpt + pMsg->numRcpts; ++i)
+	{
+		MailRecipient &rcpt = mRecipients[i];
+
+		if (rcpt.success == Pending)
+			rcpt.success = success;
+
+		if (rcpt.success != Positive)
+			++mNumRcptsFailed;
+	}
+}
+
+/*
+ * Replies arrive in order of the RCPT commands
+Literature
+- https://datatracker.ietf.org/doc/html/rfc5321#section-4.1.1.3
+- https://datatracker.ietf.org/doc/html/rfc5321#section-4.2
+*/
+void MailSending::rcptReplyParse(const char *pData, size_t len)
+{
+	const MailMsg *pMsg = &mMsgs[mIdxMsg];
+	MailRecipient *pRcpt;
+
+	// Continuation lines of multiline replies are ignored
+	if (len < 4 || pData[3] != ' ')
+		return;
+
+	if (mNumRcptsAck >= mNumRcptsSent || mNumRcptsAck >= pMsg->numRcpts)
+		return;
+
+	pRcpt = &mRecipients[pMsg->idxRcpt + mNumRcptsAck];
+	++mNumRcptsAck;
+
+	if (pData[0] == '2')
+		return;
+
+	pRcpt->success = -1;
+
+	procWrnLog("recipient %s rejected: %.*s",
+			pRcpt->addr.c_str(), (int)PMIN(len, 3), pData);
+}
+
 /*
 Literature
 - https://curl.haxx.se/libcurl/c/
@@ -179,100 +530,430 @@ Literature
 */
 Success MailSending::easyHandleCreate()
 {
-	string strUrl, strUserPwd, strBodyPrefix;
-	Success success;
+	string strUrl, strUserPwd;
+	MailMsg *pMsg = &mMsgs[mIdxMsg];
+	size_t i;
 
-	procDbgLog("Recipient");
-	procDbgLog("  Name          = %s", mRecipientName.c_str());
-	procDbgLog("  Address       = %s", mRecipientAddr.c_str());
+	if (pMsg->numRcpts)
+	{
+		procDbgLog("Recipients      = %zu", pMsg->numRcpts);
+	}
+	else
+	{
+		procDbgLog("Recipient");
+		procDbgLog("  Name          = %s", pMsg->recipientName.c_str());
+		procDbgLog("  Address       = %s", pMsg->recipientAddr.c_str());
+	}
 #if 0
 	procDbgLog("Sender");
 	procDbgLog("  Name          = %s", mSenderName.c_str());
 	procDbgLog("  Address       = %s", mSenderAddr.c_str());
 #endif
-	procDbgLog("Subject         = %s", mSubject.c_str());
+	procDbgLog("Subject         = %s", pMsg->subject.c_str());
 
-	(void)success;
+	mpCurl = sessionHandleTake(mServer, mPort, mSenderAddr, hash<string>()(mPassword));
+	if (mpCurl)
+		procDbgLog("reusing session handle");
 
-	mpCurl = curl_easy_init();
 	if (!mpCurl)
-		return procErrLog(-1, "curl_easy_init() returned 0");
+	{
+		mpCurl = curl_easy_init();
+		if (!mpCurl)
+			return procErrLog(-1, "curl_easy_init() returned 0");
+
+		strUrl = "smtps://";
+		strUrl += mServer + ":" + to_string(mPort);
+		strUrl += "/target";
+		curl_easy_setopt(mpCurl, CURLOPT_URL, strUrl.c_str());
+
+		curl_easy_setopt(mpCurl, CURLOPT_MAIL_FROM, mSenderAddr.c_str());
+
+		curl_easy_setopt(mpCurl, CURLOPT_USERAGENT, "TGSA");
+		curl_easy_setopt(mpCurl, CURLOPT_UPLOAD, 1L);
+		curl_easy_setopt(mpCurl, CURLOPT_MAXREDIRS, 50L);
+		curl_easy_setopt(mpCurl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+		curl_easy_setopt(mpCurl, CURLOPT_USE_SSL, (long)CURLUSESSL_ALL);
+		curl_easy_setopt(mpCurl, CURLOPT_FTP_SKIP_PASV_IP, 1L);
+		curl_easy_setopt(mpCurl, CURLOPT_TCP_KEEPALIVE, 1L);
+		curl_easy_setopt(mpCurl, CURLOPT_UPLOAD_BUFFERSIZE, cSizeBufUpload);
+
+		curl_easy_setopt(mpCurl, CURLOPT_READFUNCTION, MailSending::stringToCurlDataRead);
+		curl_easy_setopt(mpCurl, CURLOPT_DEBUGFUNCTION, MailSending::curlSmtpTrace);
+
+		// Rejected recipients don't abort the transaction
+#if LIBCURL_VERSION_NUM >= 0x080200
+		curl_easy_setopt(mpCurl, CURLOPT_MAIL_RCPT_ALLOWFAILS, 1L);
+#elif LIBCURL_VERSION_NUM >= 0x074500
+		curl_easy_setopt(mpCurl, CURLOPT_MAIL_RCPT_ALLLOWFAILS, 1L);
+#endif
+	}
 
-	strUrl = "smtps://";
-	strUrl += mServer + ":" + to_string(mPort);
-	strUrl += "/target";
-	curl_easy_setopt(mpCurl, CURLOPT_URL, strUrl.c_str());
+	/*
+	 * Always set. The cached connection of a reused handle
+	 * is only taken by cURL if the credentials match
+	 */
+	strUserPwd = mSenderAddr + ":" + mPassword;
+	curl_easy_setopt(mpCurl, CURLOPT_USERPWD, strUserPwd.c_str());
 
 	mpListRecipients = NULL;
-	mpListRecipients = curl_slist_append(mpListRecipients, mRecipientAddr.c_str());
+
+	if (!pMsg->numRcpts)
+		mpListRecipients = curl_slist_append(mpListRecipients, pMsg->recipientAddr.c_str());
+
+	for (i = pMsg->idxRcpt; i < pMsg->idxRcpt + pMsg->numRcpts; ++i)
+	{
+		struct curl_slist *pList;
+
+		pList = curl_slist_append(mpListRecipients, mRecipients[i].addr.c_str());
+		if (!pList)
+			return procErrLog(-1, "could not create recipient list");
+
+		mpListRecipients = pList;
+	}
+
 	curl_easy_setopt(mpCurl, CURLOPT_MAIL_RCPT, mpListRecipients);
 
-	strUserPwd = mSenderAddr + ":" + mPassword;
-	curl_easy_setopt(mpCurl, CURLOPT_USERPWD, strUserPwd.c_str());
+	// Replies to RCPT commands are only visible in the trace
+	mNumRcptsSent = 0;
+	mNumRcptsAck = 0;
 
-	curl_easy_setopt(mpCurl, CURLOPT_MAIL_FROM, mSenderAddr.c_str());
-
-	curl_easy_setopt(mpCurl, CURLOPT_USERAGENT, "TGSA");
-	curl_easy_setopt(mpCurl, CURLOPT_UPLOAD, 1L);
-	curl_easy_setopt(mpCurl, CURLOPT_MAXREDIRS, 50L);
-	curl_easy_setopt(mpCurl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
-	curl_easy_setopt(mpCurl, CURLOPT_USE_SSL, (long)CURLUSESSL_ALL);
-	curl_easy_setopt(mpCurl, CURLOPT_FTP_SKIP_PASV_IP, 1L);
-	curl_easy_setopt(mpCurl, CURLOPT_TCP_KEEPALIVE, 1L);
-	curl_easy_setopt(mpCurl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)(mBody.size() + 20));
-	curl_easy_setopt(mpCurl, CURLOPT_BUFFERSIZE, 59L);
-	curl_easy_setopt(mpCurl, CURLOPT_UPLOAD_BUFFERSIZE, 59L); // Not working. Minimum is 16k
-
-	strBodyPrefix += "To: ";
-	strBodyPrefix += mRecipientName;
-	strBodyPrefix += " <";
-	strBodyPrefix += mRecipientAddr;
-	strBodyPrefix += ">";
-	strBodyPrefix += "\r\n";
-
-	strBodyPrefix += "From: ";
-	strBodyPrefix += mSenderName;
-	strBodyPrefix += " <";
-	strBodyPrefix += mSenderAddr;
-	strBodyPrefix += ">";
-	strBodyPrefix += "\r\n";
-
-	strBodyPrefix += "Subject: ";
-	strBodyPrefix += mSubject;
-	strBodyPrefix += "\r\n";
-	strBodyPrefix += "\r\n";
-
-	mBody = strBodyPrefix + mBody;
-
-	curl_easy_setopt(mpCurl, CURLOPT_READFUNCTION, MailSending::stringToCurlDataRead);
-	curl_easy_setopt(mpCurl, CURLOPT_READDATA, this);
+	curl_easy_setopt(mpCurl, CURLOPT_VERBOSE, pMsg->numRcpts ? 1L : 0L);
+	curl_easy_setopt(mpCurl, CURLOPT_DEBUGDATA, this);
 
-	curl_easy_setopt(mpCurl, CURLOPT_PRIVATE, this);
+	if (msgAssemble(pMsg) != Positive)
+		return -1;
 
-	//curl_easy_setopt(mpCurl, CURLOPT_VERBOSE, 1L);
+	curl_easy_setopt(mpCurl, CURLOPT_READDATA, this);
+	curl_easy_setopt(mpCurl, CURLOPT_PRIVATE, this);
 
 	return Positive;
 }
 
 Success MailSending::curlEasyHandleBind()
 {
-	lock_guard<mutex> lock(mtxCurlMulti);
+	Success success;
 
-	if (!pCurlMulti)
-		pCurlMulti = curl_multi_init();
+	success = CurlMultiplexing::easyAdd(mpCurl, curlDone, this);
+	if (success != Positive)
+		return procErrLog(-1, "could not bind curl easy handle");
 
-	if (!pCurlMulti)
-		return procErrLog(-1, "could not create curl multi handle");
+	mCurlBound = true;
 
-	CURLMcode code;
+	return Positive;
+}
 
-	code = curl_multi_add_handle(pCurlMulti, mpCurl);
-	if (code != CURLM_OK)
-		return procErrLog(-1, "could not bind curl easy handle");
+/*
+ * No callback of the transfer runs after the handle has been
+ * removed. Also if the transfers are driven by another thread
+ */
+void MailSending::curlEasyHandleUnbind()
+{
+	if (!mCurlBound)
+		return;
+
+	CurlMultiplexing::easyRemove(mpCurl);
+	mCurlBound = false;
+}
+
+/*
+ * The connection of the handle stays in the shared
+ * connection cache of CurlMultiplexing(). Reusing the handle for the
+ * same server and user skips connect, TLS handshake and AUTH
+ */
+void MailSending::easyHandleRelease(bool reuse)
+{
+	curlEasyHandleUnbind();
+
+	if (mpListRecipients)
+	{
+		curl_easy_setopt(mpCurl, CURLOPT_MAIL_RCPT, NULL);
+		curl_slist_free_all(mpListRecipients);
+		mpListRecipients = NULL;
+	}
+
+	if (!mpCurl)
+		return;
+
+	if (reuse)
+		sessionHandleGive(mServer, mPort, mSenderAddr, hash<string>()(mPassword), mpCurl);
+	else
+		curl_easy_cleanup(mpCurl);
+
+	mpCurl = NULL;
+}
+
+/*
+Literature
+- https://datatracker.ietf.org/doc/html/rfc5322
+- https://datatracker.ietf.org/doc/html/rfc2045
+- https://datatracker.ietf.org/doc/html/rfc2046#section-5.1
+*/
+Success MailSending::msgAssemble(const MailMsg *pMsg)
+{
+	size_t sizeTotal = 0;
+	size_t i;
+
+	mData.clear();
+	mData.reserve(256 + mHdrRcpts.size() + pMsg->recipientName.size() + pMsg->recipientAddr.size() +
+				mSenderName.size() + mSenderAddr.size() + pMsg->subject.size());
+
+	if (pMsg->numRcpts)
+	{
+		mData.append(mHdrRcpts);
+	}
+	else
+	{
+		mData.append("To: ").append(pMsg->recipientName);
+		mData.append(" <").append(pMsg->recipientAddr).append(">\r\n");
+	}
+
+	mData.append("From: ").append(mSenderName);
+	mData.append(" <").append(mSenderAddr).append(">\r\n");
+
+	mData.append("Subject: ").append(pMsg->subject).append("\r\n");
+
+	if (mAttachments.size())
+	{
+		mData.append("MIME-Version: 1.0\r\n");
+		mData.append("Content-Type: multipart/mixed; boundary=\"");
+		mData.append(mBoundary).append("\"\r\n");
+		mData.append("\r\n");
+
+		mData.append("--").append(mBoundary).append("\r\n");
+		mData.append("Content-Type: text/plain; charset=UTF-8\r\n");
+		mData.append("Content-Transfer-Encoding: 8bit\r\n");
+	}
+
+	mData.append("\r\n");
+
+	mSegments.clear();
+	mIdxSeg = 0;
+	mOffSeg = 0;
+	mLenLine = 0;
+	mOffLine = 0;
+	mReadFailed = false;
+
+	// Body and attachments are referenced. Not copied
+	segmentAdd(&mData, 0, mData.size());
+	segmentAdd(&pMsg->body, 0, pMsg->body.size());
+
+	if (mAttachments.size() && partsAssemble() != Positive)
+		return -1;
+
+	for (i = 0; i < mSegments.size(); ++i)
+		sizeTotal += mSegments[i].len;
+
+	curl_easy_setopt(mpCurl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)sizeTotal);
 
 	return Positive;
 }
 
+Success MailSending::partsAssemble()
+{
+	vector<MailAttachment>::const_iterator iter;
+	vector<size_t> offsParts;
+	struct stat st;
+	size_t i;
+
+	// Offsets are used because the buffer may be reallocated
+	mDataParts.clear();
+	offsParts.reserve(mAttachments.size() + 1);
+
+	for (iter = mAttachments.begin(); iter != mAttachments.end(); ++iter)
+	{
+		offsParts.push_back(mDataParts.size());
+
+		mDataParts.append("\r\n--").append(mBoundary).append("\r\n");
+		mDataParts.append("Content-Type: ").append(iter->contentType);
+		mDataParts.append("; name=\"").append(iter->name).append("\"\r\n");
+		mDataParts.append("Content-Disposition: attachment; filename=\"");
+		mDataParts.append(iter->name).append("\"\r\n");
+		mDataParts.append("Content-Transfer-Encoding: base64\r\n");
+		mDataParts.append("\r\n");
+	}
+
+	offsParts.push_back(mDataParts.size());
+	mDataParts.append("\r\n--").append(mBoundary).append("--\r\n");
+
+	for (i = 0; i < mAttachments.size(); ++i)
+	{
+		const MailAttachment &att = mAttachments[i];
+		MailSegment seg;
+
+		segmentAdd(&mDataParts, offsParts[i], offsParts[i + 1] - offsParts[i]);
+
+		seg.pStr = NULL;
+		seg.offs = 0;
+		seg.pAtt = &att;
+		seg.sizeRaw = att.data.size();
+
+		if (att.path.size())
+		{
+			if (stat(att.path.c_str(), &st))
+				return procErrLog(-1, "could not get size of attachment %s: %s",
+							att.path.c_str(), strerror(errno));
+
+			seg.sizeRaw = st.st_size;
+		}
+
+		// Full lines with CRLF. Last line may be shorter
+		seg.len = (seg.sizeRaw / cSizeLineRaw) * cSizeLineEnc;
+		if (seg.sizeRaw % cSizeLineRaw)
+			seg.len += ((seg.sizeRaw % cSizeLineRaw + 2) / 3) * 4 + 2;
+
+		mSegments.push_back(seg);
+	}
+
+	segmentAdd(&mDataParts, offsParts.back(), mDataParts.size() - offsParts.back());
+
+	return Positive;
+}
+
+void MailSending::segmentAdd(const string *pStr, size_t offs, size_t len)
+{
+	MailSegment seg;
+
+	seg.pStr = pStr;
+	seg.offs = offs;
+	seg.len = len;
+	seg.pAtt = NULL;
+	seg.sizeRaw = 0;
+
+	mSegments.push_back(seg);
+}
+
+size_t MailSending::segmentsRead(char *pBuf, size_t len)
+{
+	char *pOut = pBuf;
+	size_t lenDone;
+	bool segDone;
+
+	while (len && mIdxSeg < mSegments.size())
+	{
+		const MailSegment &seg = mSegments[mIdxSeg];
+
+		if (seg.pAtt)
+		{
+			lenDone = attachmentRead(seg, pOut, len);
+			if (mReadFailed)
+				return CURL_READFUNC_ABORT;
+
+			segDone = mOffSeg >= seg.sizeRaw && mOffLine >= mLenLine;
+		}
+		else
+		{
+			lenDone = PMIN(len, seg.len - mOffSeg);
+
+			memcpy(pOut, seg.pStr->data() + seg.offs + mOffSeg, lenDone);
+			mOffSeg += lenDone;
+
+			segDone = mOffSeg >= seg.len;
+		}
+
+		pOut += lenDone;
+		len -= lenDone;
+
+		if (!segDone)
+			continue;
+
+		fileClose();
+
+		++mIdxSeg;
+		mOffSeg = 0;
+		mLenLine = 0;
+		mOffLine = 0;
+	}
+
+	return pOut - pBuf;
+}
+
+/*
+ * Whole lines are encoded directly into the buffer of cURL.
+ * If there is no space left for a line, it is staged
+ */
+size_t MailSending::attachmentRead(const MailSegment &seg, char *pBuf, size_t len)
+{
+	uint8_t bufRaw[cSizeLineRaw * cNumLinesChunk];
+	const uint8_t *pRaw;
+	char *pOut = pBuf;
+	size_t lenRaw, lenDone, numLines;
+
+	// Rest of staged line
+	lenDone = PMIN(len, mLenLine - mOffLine);
+	if (lenDone)
+	{
+		memcpy(pOut, mLine + mOffLine, lenDone);
+		mOffLine += lenDone;
+
+		pOut += lenDone;
+		len -= lenDone;
+	}
+
+	while (len && mOffSeg < seg.sizeRaw)
+	{
+		numLines = PMIN(len / cSizeLineEnc, cNumLinesChunk);
+		lenRaw = PMIN(PMAX(numLines, 1) * cSizeLineRaw, seg.sizeRaw - mOffSeg);
+
+		if (seg.pAtt->path.size())
+		{
+			if (!mpFile)
+				mpFile = fopen(seg.pAtt->path.c_str(), "rb");
+
+			if (!mpFile)
+			{
+				mReadFailed = true;
+				procErrLog(-1, "could not open attachment %s: %s",
+						seg.pAtt->path.c_str(), strerror(errno));
+				return 0;
+			}
+
+			// Size must match the announced size
+			if (fread(bufRaw, 1, lenRaw, mpFile) != lenRaw)
+			{
+				mReadFailed = true;
+				procErrLog(-1, "could not read attachment %s",
+						seg.pAtt->path.c_str());
+				return 0;
+			}
+
+			pRaw = bufRaw;
+		}
+		else
+			pRaw = (const uint8_t *)seg.pAtt->data.data() + mOffSeg;
+
+		mOffSeg += lenRaw;
+
+		if (numLines)
+		{
+			lenDone = base64LinesEncode(pRaw, lenRaw, pOut);
+
+			pOut += lenDone;
+			len -= lenDone;
+
+			continue;
+		}
+
+		mLenLine = base64LinesEncode(pRaw, lenRaw, mLine);
+		mOffLine = PMIN(len, mLenLine);
+
+		memcpy(pOut, mLine, mOffLine);
+
+		pOut += mOffLine;
+		len -= mOffLine;
+	}
+
+	return pOut - pBuf;
+}
+
+void MailSending::fileClose()
+{
+	if (!mpFile)
+		return;
+
+	fclose(mpFile);
+	mpFile = NULL;
+}
+
 void MailSending::nameAddrSplit(const string &strIn, string &name, string &addr)
 {
 	size_t pos;
@@ -302,76 +983,268 @@ void MailSending::processInfo(char *pBuf, char *pBufEnd)
 /* static functions */
 
 /*
+ * May run on the thread of CurlMultiplexing(). Results
+ * are published by the release store of mDone.
+ * mCurlBound is owned by the client and not touched
+ *
 Literature
 - https://en.wikipedia.org/wiki/List_of_SMTP_server_return_codes#%E2%80%94_2yz_Positive_completion
 */
-void MailSending::multiProcess()
+void MailSending::curlDone(CURL *pCurl, CURLcode res, void *pUser)
 {
-	lock_guard<mutex> lock(mtxCurlMulti);
+	MailSending *pReq = (MailSending *)pUser;
+	MailMsg *pMsg = &pReq->mMsgs[pReq->mIdxMsg];
+
+	pMsg->curlRes = res;
+	curl_easy_getinfo(pCurl, CURLINFO_RESPONSE_CODE, &pMsg->respCode);
+
+	pReq->mDone.store(Positive, memory_order_release);
+}
+
+void MailSending::sessionsDeInit()
+{
+	lock_guard<mutex> lock(sessionMtx);
+	list<MailSession>::iterator iter;
+	list<MailSessionHandle>::iterator iHdl;
+
+	for (iter = sessions.begin(); iter != sessions.end(); ++iter)
+	{
+		iHdl = iter->lstIdle.begin();
+		for (; iHdl != iter->lstIdle.end(); ++iHdl)
+			curl_easy_cleanup(iHdl->pCurl);
+	}
+
+	sessions.clear();
+
+	dbgLog("MailSending(): session cleanup done");
+}
+
+extern "C" size_t MailSending::stringToCurlDataRead(char *ptr, size_t size, size_t nmemb, MailSending *pReq)
+{
+	size_t numRead;
+
+	numRead = pReq->segmentsRead(ptr, size * nmemb);
+	if (numRead == CURL_READFUNC_ABORT)
+		return numRead;
+
+	if (!numRead)
+		return 0;
+
+	pReq->mNumSent += numRead;
+	pReq->mStartMs.store(millis(), memory_order_relaxed);
+#if 0
+	wrnLog("Mail data sent: %d", pReq->mNumSent);
+#endif
+	return numRead;
+}
 
-	int numRunningRequests, numMsgsLeft;
-	CURLMsg *curlMsg;
+/*
+ * Handles are keyed by the credentials as well.
+ * A process with a wrong password must never
+ * use a connection authenticated by another one
+ */
+CURL *MailSending::sessionHandleTake(const string &server, uint16_t port,
+					const string &user, size_t hashPassword)
+{
+	lock_guard<mutex> lock(sessionMtx);
+	list<MailSession>::iterator iter;
 	CURL *pCurl;
-	MailSending *pReq;
 
-	curl_multi_perform(pCurlMulti, &numRunningRequests);
+	sessionsIdlePurge();
 
-	while (curlMsg = curl_multi_info_read(pCurlMulti, &numMsgsLeft), curlMsg)
+	for (iter = sessions.begin(); iter != sessions.end(); ++iter)
 	{
-		if (curlMsg->msg != CURLMSG_DONE)
+		if (iter->server != server || iter->port != port || iter->user != user ||
+				iter->hashPassword != hashPassword)
 			continue;
 
-		pCurl = curlMsg->easy_handle;
+		if (!iter->lstIdle.size())
+			return NULL;
+
+		// Most recently used. Connection most likely still open
+		pCurl = iter->lstIdle.back().pCurl;
+		iter->lstIdle.pop_back();
+
+		return pCurl;
+	}
+
+	return NULL;
+}
+
+void MailSending::sessionHandleGive(const string &server, uint16_t port,
+					const string &user, size_t hashPassword, CURL *pCurl)
+{
+	lock_guard<mutex> lock(sessionMtx);
+	list<MailSession>::iterator iter;
+	MailSessionHandle hdl;
+
+	for (iter = sessions.begin(); iter != sessions.end(); ++iter)
+	{
+		if (iter->server == server && iter->port == port && iter->user == user &&
+				iter->hashPassword == hashPassword)
+			break;
+	}
+
+	if (!sessionsDeInitRegistered)
+	{
+		Processing::globalDestructorRegister(sessionsDeInit);
+		sessionsDeInitRegistered = true;
+	}
+
+	if (iter == sessions.end())
+	{
+		sessions.emplace_front();
+		iter = sessions.begin();
+
+		iter->server = server;
+		iter->port = port;
+		iter->user = user;
+		iter->hashPassword = hashPassword;
+	}
+
+	if (iter->lstIdle.size() >= cNumSessionHandlesMax)
+	{
+		curl_easy_cleanup(pCurl);
+		return;
+	}
+
+	hdl.pCurl = pCurl;
+	hdl.msIdle = millis();
 
-		curl_easy_getinfo(pCurl, CURLINFO_PRIVATE, &pReq);
+	iter->lstIdle.push_back(hdl);
+}
 
-		pReq->mCurlRes = curlMsg->data.result;
-		curl_easy_getinfo(pCurl, CURLINFO_RESPONSE_CODE, &pReq->mRespCode);
+/*
+ * Must be called with the session mutex locked
+ */
+void MailSending::sessionsIdlePurge()
+{
+	list<MailSession>::iterator iter;
+	uint32_t curTimeMs = millis();
 
-		curl_multi_remove_handle(pCurlMulti, pCurl);
+	iter = sessions.begin();
+	while (iter != sessions.end())
+	{
+		// Ordered by time of release
+		while (iter->lstIdle.size() &&
+				curTimeMs - iter->lstIdle.front().msIdle > cMsSessionIdleMax)
+		{
+			curl_easy_cleanup(iter->lstIdle.front().pCurl);
+			iter->lstIdle.pop_front();
+		}
 
-		if (pReq->mpListRecipients)
+		if (iter->lstIdle.size())
 		{
-			curl_slist_free_all(pReq->mpListRecipients);
-			pReq->mpListRecipients = NULL;
+			++iter;
+			continue;
 		}
 
-		curl_easy_cleanup(pReq->mpCurl);
-		pReq->mpCurl = NULL;
+		iter = sessions.erase(iter);
+	}
+}
 
-		pReq->mDone = Positive;
+extern "C" int MailSending::curlSmtpTrace(CURL *pCurl, curl_infotype type, char *pData, size_t size, MailSending *pReq)
+{
+	if (type == CURLINFO_HEADER_OUT && size >= 8 && !strncmp(pData, "RCPT TO:", 8))
+	{
+		++pReq->mNumRcptsSent;
+		return 0;
 	}
+
+	if (type == CURLINFO_HEADER_IN)
+		pReq->rcptReplyParse(pData, size);
+
+	return 0;
 }
 
-void MailSending::curlMultiDeInit()
+/*
+ * Lines of 57 bytes are encoded to 76 characters and CRLF
+ */
+size_t MailSending::base64LinesEncode(const uint8_t *pIn, size_t len, char *pOut)
 {
-	lock_guard<mutex> lock(mtxCurlMulti);
+	const uint8_t *pEnd = pIn + len;
+	char *pStart = pOut;
+	size_t lenLine;
+	uint32_t v;
 
-	if (!pCurlMulti)
-		return;
+	while (pIn < pEnd)
+	{
+		lenLine = PMIN(cSizeLineRaw, (size_t)(pEnd - pIn));
+
+		for (; lenLine >= 3; lenLine -= 3, pIn += 3)
+		{
+			v = pIn[0] << 16 | pIn[1] << 8 | pIn[2];
+
+			*pOut++ = cBase64Chars[v >> 18];
+			*pOut++ = cBase64Chars[(v >> 12) & 0x3F];
+			*pOut++ = cBase64Chars[(v >> 6) & 0x3F];
+			*pOut++ = cBase64Chars[v & 0x3F];
+		}
+
+		if (lenLine)
+		{
+			v = pIn[0] << 16;
+			if (lenLine > 1)
+				v |= pIn[1] << 8;
 
-	curl_multi_cleanup(pCurlMulti);
-	pCurlMulti = NULL;
+			*pOut++ = cBase64Chars[v >> 18];
+			*pOut++ = cBase64Chars[(v >> 12) & 0x3F];
+			*pOut++ = lenLine > 1 ? cBase64Chars[(v >> 6) & 0x3F] : '=';
+			*pOut++ = '=';
 
-	dbgLog("MailSending(): multi curl cleanup done");
+			pIn += lenLine;
+		}
+
+		*pOut++ = '\r';
+		*pOut++ = '\n';
+	}
+
+	return pOut - pStart;
 }
 
-extern "C" size_t MailSending::stringToCurlDataRead(char *ptr, size_t size, size_t nmemb, MailSending *pReq)
+/*
+ * Content of a quoted string. Backslash and quote
+ * are escaped. Control characters can't be escaped
+ * and are replaced
+ *
+ * Literature
+ * - https://datatracker.ietf.org/doc/html/rfc5322#section-3.2.4
+ */
+string MailSending::paramQuote(const string &str)
 {
-	size_t numReq = size * nmemb;
-	size_t numLeft = pReq->mBody.size() - pReq->mNumSent;
-	size_t numRead = PMIN(numReq, numLeft);
+	string res;
 
-	if (!numRead)
-		return 0;
+	res.reserve(str.size());
 
-	const char *pRead = pReq->mBody.c_str() + pReq->mNumSent;
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		unsigned char ch = str[i];
 
-	memcpy(ptr, pRead, numRead);
-	pReq->mNumSent += numRead;
-#if 0
-	wrnLog("Mail data sent: %d", pReq->mNumSent);
-#endif
-	return numRead;
+		if (ch == '"' || ch == '\\')
+			res.push_back('\\');
+		else
+		if (ch < ' ' || ch == 0x7F)
+			ch = '_';
+
+		res.push_back(ch);
+	}
+
+	return res;
+}
+
+/*
+ * Line breaks would end the header
+ */
+bool MailSending::headerValueValid(const string &str)
+{
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		unsigned char ch = str[i];
+
+		if (ch < ' ' || ch == 0x7F)
+			return false;
+	}
+
+	return str.size() > 0;
 }
 
@@ -26,16 +26,90 @@
 #ifndef MAIL_SENDING_H
 #define MAIL_SENDING_H
 
+#include <list>
+#include <vector>
+#include <cstdio>
+#include <atomic>
+
 #include "Processing.h"
 #include "LibDspc.h"
+#include "CurlMultiplexing.h"
 
 #define dForEach_MailSeState(gen) \
 		gen(MailSeStart) \
+		gen(MailSeMsgStart) \
 		gen(MailSeDoneWait) \
 
 #define dGenMailSeStateEnum(s) s,
 dProcessStateEnum(MailSeState);
 
+enum MailRcptType
+{
+	MailRcptTo = 0,
+	MailRcptCc,
+	MailRcptBcc,
+};
+
+struct MailRecipient
+{
+	std::string addr;
+	std::string name;
+	MailRcptType type;
+	Success success;
+};
+
+struct MailMsg
+{
+	std::string recipientAddr;
+	std::string recipientName;
+	std::string subject;
+	std::string body;
+	Success success;
+	CURLcode curlRes;
+	long respCode;
+	size_t idxRcpt; // Range of recipient list. Used if numRcpts > 0
+	size_t numRcpts;
+};
+
+struct MailSessionHandle
+{
+	CURL *pCurl;
+	uint32_t msIdle;
+};
+
+// Attached either from memory or from a file
+struct MailAttachment
+{
+	std::string name;
+	std::string contentType;
+	std::string path; // Streamed from file if set
+	std::string data;
+};
+
+/*
+ * The message is sent as sequence of segments.
+ * Literal segments reference existing strings.
+ * Attachments are base64 encoded on the fly
+ */
+struct MailSegment
+{
+	const std::string *pStr;
+	size_t offs;
+	size_t len;
+	const MailAttachment *pAtt;
+	size_t sizeRaw;
+};
+
+// Easy handles with authenticated connections to the same server and user
+struct MailSession
+{
+	std::string server;
+	uint16_t port;
+	std::string user;
+	size_t hashPassword; // Password itself is not kept
+	std::list<MailSessionHandle> lstIdle;
+};
+
 class MailSending : public Processing
 {
 
@@ -54,6 +128,34 @@ public:
 
 	void subjectSet(const std::string &subject);
 	void bodySet(const std::string &body);
+	void msTimeoutSet(uint32_t msTimeout);
+
+	void msgAdd(const std::string &recipient,
+			const std::string &subject,
+			const std::string &body);
+
+	size_t numMsgs() const
+	{ return mMsgs.size(); }
+	size_t numMsgsFailed() const
+	{ return mNumMsgsFailed; }
+	Success msgSuccess(size_t idx) const;
+	long msgRespCode(size_t idx) const;
+
+	void recipientAdd(const std::string &recipient, MailRcptType type = MailRcptTo);
+	void numRcptsPerMsgMaxSet(size_t numMax);
+
+	size_t numRecipients() const
+	{ return mRecipients.size(); }
+	size_t numRecipientsFailed() const
+	{ return mNumRcptsFailed; }
+	Success recipientSuccess(size_t idx) const;
+
+	void attachmentAdd(const std::string &name,
+			const std::string &data,
+			const std::string &contentType = "application/octet-stream");
+	void attachmentFileAdd(const std::string &path,
+			const std::string &name = "",
+			const std::string &contentType = "application/octet-stream");
 
 protected:
 
@@ -76,12 +178,25 @@ private:
 
 	Success easyHandleCreate();
 	Success curlEasyHandleBind();
+	void curlEasyHandleUnbind();
+	void easyHandleRelease(bool reuse);
+	void msgFinish(Success success);
+	void rcptMsgsCreate();
+	void rcptsFinish(const MailMsg *pMsg, Success success);
+	void rcptReplyParse(const char *pData, size_t len);
+	Success msgAssemble(const MailMsg *pMsg);
+	Success partsAssemble();
+	void segmentAdd(const std::string *pStr, size_t offs, size_t len);
+	size_t segmentsRead(char *pBuf, size_t len);
+	size_t attachmentRead(const MailSegment &seg, char *pBuf, size_t len);
+	void fileClose();
 
 	void nameAddrSplit(const std::string &strIn, std::string &name, std::string &addr);
 
 	/* member variables */
 	MailSeState mState;
-	uint32_t mStartMs;
+	std::atomic<uint32_t> mStartMs; // Also updated by cURL callbacks
+	uint32_t mMsTimeout;
 	std::string mServer;
 	uint16_t mPort;
 	std::string mPassword;
@@ -91,25 +206,57 @@ private:
 	std::string mSenderName;
 	std::string mSubject;
 	std::string mBody;
+	std::string mData; // Headers of message currently being sent
+	std::string mDataParts; // Part headers of attachments
+	std::string mBoundary;
+	std::vector<MailAttachment> mAttachments;
+	std::vector<MailSegment> mSegments;
+	size_t mIdxSeg;
+	size_t mOffSeg;
+	FILE *mpFile;
+	char mLine[80];
+	size_t mLenLine;
+	size_t mOffLine;
+	bool mReadFailed;
+
+	std::vector<MailMsg> mMsgs;
+	size_t mIdxMsg;
+	size_t mNumMsgsFailed;
+
+	std::vector<MailRecipient> mRecipients;
+	std::string mHdrRcpts;
+	size_t mNumRcptsPerMsgMax;
+	size_t mNumRcptsFailed;
+	size_t mNumRcptsSent; // RCPT commands of current transaction
+	size_t mNumRcptsAck;
 
 	CURL *mpCurl;
+	bool mCurlBound;
 	struct curl_slist *mpListRecipients;
 
 	size_t mNumSent;
 
-	Success mDone;
-	CURLcode mCurlRes;
-	long mRespCode;
+	std::atomic<Success> mDone; // Set by the thread driving the transfers
 
 	/* static functions */
-	static void multiProcess();
-	static void curlMultiDeInit();
+	static void curlDone(CURL *pCurl, CURLcode res, void *pUser);
+	static void sessionsDeInit();
+	static CURL *sessionHandleTake(const std::string &server, uint16_t port,
+					const std::string &user, size_t hashPassword);
+	static void sessionHandleGive(const std::string &server, uint16_t port,
+					const std::string &user, size_t hashPassword, CURL *pCurl);
+	static void sessionsIdlePurge();
+	static size_t base64LinesEncode(const uint8_t *pIn, size_t len, char *pOut);
+	static std::string paramQuote(const std::string &str);
+	static bool headerValueValid(const std::string &str);
 
 	static size_t stringToCurlDataRead(char *ptr, size_t size, size_t nmemb, MailSending *pReq);
+	static int curlSmtpTrace(CURL *pCurl, curl_infotype type, char *pData, size_t size, MailSending *pReq);
 
 	/* static variables */
-	static std::mutex mtxCurlMulti;
-	static CURLM *pCurlMulti;
+	static std::mutex sessionMtx;
+	static std::list<MailSession> sessions;
+	static bool sessionsDeInitRegistered;
 
 	/* constants */
 
@@ -0,0 +1,217 @@
+/*
+  This file is part of the DSP-Crowd project
+  https://www.dsp-crowd.com
+
+  Author(s):
+      - Johannes Natter, office@dsp-crowd.com
+
+  File created on 19.10.2026
+
+  Copyright (C) 2026, Johannes Natter
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <algorithm>
+
+#include "RingBuffer.h"
+
+using namespace std;
+
+RingBuffer::RingBuffer(size_t sizeInit, size_t sizeMax)
+	: mBuf()
+	, mIdxRead(0)
+	, mSize(0)
+	, mSizeMax(sizeMax)
+{
+	size_t cap = 1;
+
+	while (cap < sizeInit)
+		cap <<= 1;
+
+	mBuf.resize(cap);
+}
+
+RingBuffer::~RingBuffer()
+{
+}
+
+/* member functions */
+
+size_t RingBuffer::size() const
+{
+	return mSize;
+}
+
+size_t RingBuffer::capacity() const
+{
+	return mBuf.size();
+}
+
+bool RingBuffer::empty() const
+{
+	return !mSize;
+}
+
+/*
+ * Grows the buffer if necessary.
+ * Returns the number of bytes actually written.
+ * Less than len is only possible if the maximum size is reached
+ */
+size_t RingBuffer::write(const void *pData, size_t len)
+{
+	if (!pData || !len)
+		return 0;
+
+	if (mSize + len > mBuf.size())
+		grow(mSize + len);
+
+	size_t cap = mBuf.size();
+	size_t lenFree = cap - mSize;
+
+	if (mSizeMax && mSizeMax < cap)
+		lenFree = mSizeMax > mSize ? mSizeMax - mSize : 0;
+
+	if (len > lenFree)
+		len = lenFree;
+
+	size_t idxWrite = (mIdxRead + mSize) & (cap - 1);
+	size_t lenFirst = min(len, cap - idxWrite);
+
+	memcpy(&mBuf[idxWrite], pData, lenFirst);
+	memcpy(&mBuf[0], (const char *)pData + lenFirst, len - lenFirst);
+
+	mSize += len;
+
+	return len;
+}
+
+size_t RingBuffer::read(void *pBuf, size_t len)
+{
+	len = peek(pBuf, len);
+	drop(len);
+
+	return len;
+}
+
+size_t RingBuffer::peek(void *pBuf, size_t len, size_t offs) const
+{
+	if (!pBuf || offs >= mSize)
+		return 0;
+
+	if (len > mSize - offs)
+		len = mSize - offs;
+
+	size_t cap = mBuf.size();
+	size_t idx = (mIdxRead + offs) & (cap - 1);
+	size_t lenFirst = min(len, cap - idx);
+
+	memcpy(pBuf, &mBuf[idx], lenFirst);
+	memcpy((char *)pBuf + lenFirst, &mBuf[0], len - lenFirst);
+
+	return len;
+}
+
+// Returns the offset of ch relative to the read position or npos
+size_t RingBuffer::find(char ch, size_t offs) const
+{
+	if (offs >= mSize)
+		return npos;
+
+	size_t cap = mBuf.size();
+	size_t idx = (mIdxRead + offs) & (cap - 1);
+	size_t lenLeft = mSize - offs;
+	size_t lenFirst = min(lenLeft, cap - idx);
+	const char *pFound;
+
+	pFound = (const char *)memchr(&mBuf[idx], ch, lenFirst);
+	if (pFound)
+		return offs + (pFound - &mBuf[idx]);
+
+	pFound = (const char *)memchr(&mBuf[0], ch, lenLeft - lenFirst);
+	if (pFound)
+		return offs + lenFirst + (pFound - &mBuf[0]);
+
+	return npos;
+}
+
+/*
+ * Makes the first len bytes contiguous in memory.
+ * Data is only moved if it wraps around the end of the buffer.
+ * The returned pointer is valid until the next write() or linear()
+ */
+const char *RingBuffer::linear(size_t len)
+{
+	if (len > mSize)
+		return NULL;
+
+	if (mIdxRead + len > mBuf.size())
+	{
+		rotate(mBuf.begin(), mBuf.begin() + mIdxRead, mBuf.end());
+		mIdxRead = 0;
+	}
+
+	return &mBuf[mIdxRead];
+}
+
+void RingBuffer::drop(size_t len)
+{
+	if (len > mSize)
+		len = mSize;
+
+	mIdxRead = (mIdxRead + len) & (mBuf.size() - 1);
+	mSize -= len;
+
+	if (!mSize)
+		mIdxRead = 0;
+}
+
+void RingBuffer::clear()
+{
+	mIdxRead = 0;
+	mSize = 0;
+}
+
+/*
+ * Capacity stays a power of two.
+ * The maximum size limits the buffered data, not the capacity.
+ * Capacity is rounded up so that the maximum size always fits
+ */
+bool RingBuffer::grow(size_t sizeReq)
+{
+	size_t capOld = mBuf.size();
+	size_t cap = capOld;
+
+	if (mSizeMax && sizeReq > mSizeMax)
+		sizeReq = mSizeMax;
+
+	while (cap < sizeReq)
+		cap <<= 1;
+
+	if (cap <= capOld)
+		return false;
+
+	vector<char> buf(cap);
+
+	peek(buf.data(), mSize);
+
+	mBuf.swap(buf);
+	mIdxRead = 0;
+
+	return true;
+}
+
+/* static functions */
+
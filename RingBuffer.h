@@ -0,0 +1,79 @@
+/*
+  This file is part of the DSP-Crowd project
+  https://www.dsp-crowd.com
+
+  Author(s):
+      - Johannes Natter, office@dsp-crowd.com
+
+  File created on 19.10.2026
+
+  Copyright (C) 2026, Johannes Natter
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <cstddef>
+#include <vector>
+
+class RingBuffer
+{
+
+public:
+	RingBuffer(size_t sizeInit = 512, size_t sizeMax = 0);
+	virtual ~RingBuffer();
+
+	size_t size() const;
+	size_t capacity() const;
+	bool empty() const;
+
+	size_t write(const void *pData, size_t len);
+	size_t read(void *pBuf, size_t len);
+	size_t peek(void *pBuf, size_t len, size_t offs = 0) const;
+	size_t find(char ch, size_t offs = 0) const;
+	const char *linear(size_t len);
+	void drop(size_t len);
+	void clear();
+
+	static const size_t npos = (size_t)-1;
+
+private:
+
+	/*
+	 * Naming of functions:  objectVerb()
+	 * Example:              peerAdd()
+	 */
+
+	/* member functions */
+
+	bool grow(size_t sizeReq);
+
+	/* member variables */
+	std::vector<char> mBuf;
+	size_t mIdxRead;
+	size_t mSize;
+	size_t mSizeMax;
+
+	/* static functions */
+
+	/* static variables */
+
+	/* constants */
+
+};
+
+#endif
+